@@ -0,0 +1,559 @@
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "flac.h"
+#include "readahead.h"
+
+
+
+#define FLAC_BUFSIZE (1 << 16)  // Number of bytes read from file at a time
+#define FLAC_MAX_BITS 24  // Largest sample size supported, so side channels and predictions fit in 32 bits
+#define FLAC_MAX_ORDER 32
+
+typedef struct {
+	uint64_t sample;  // First sample of frame
+	uint64_t offset;  // Position of frame in bytes from the first frame
+} seekpoint_t;
+
+struct flac_s {
+	FILE *fl;
+	
+	// From STREAMINFO block
+	unsigned int min_blksize, max_blksize;
+	unsigned int sample_freq, channels, bits;
+	uint64_t sample_count;
+	
+	// From SEEKTABLE block, sorted by sample
+	seekpoint_t *points;
+	unsigned int point_count;
+	long first_frame;  // Position of first frame in file
+	
+	// Buffered input which is read a number of bits at a time
+	const uint8_t *buf;
+	uint8_t *block;  // Memory `buf` is read into when there is no read-ahead
+	readahead_t ra;
+	unsigned int buf_len, buf_pos;
+	long buf_off;  // Position of start of buffer in file
+	uint64_t cache;  // Bits which have been read from buffer but not used, aligned to most significant bit
+	int cache_bits;
+	unsigned int fake;  // Number of zero bytes added to cache after the end of the file
+	uint8_t crc;  // CRC-8 of frame header bytes read so far
+	
+	// Most recently read frame
+	int32_t *samples;  // `max_blksize` samples for each channel
+	uint64_t frame_start;
+	unsigned int frame_len;  // Zero when no frame has been read
+	int decoded;  // Whether samples of frame have been decoded or only its header was read
+};
+
+
+
+// Get position in file of first byte which is not fully used
+static long tell(flac_t flc){
+	return flc->buf_off + flc->buf_pos + flc->fake - flc->cache_bits / 8;
+}
+
+// Move to byte `offset` of file discarding any bits read
+static void seek_to(flac_t flc, long offset){
+	if(offset >= flc->buf_off && offset <= flc->buf_off + (long)flc->buf_len){
+		flc->buf_pos = offset - flc->buf_off;  // Already buffered
+	}else{
+		fseek(flc->fl, offset, SEEK_SET);
+		flc->buf_off = offset;
+		flc->buf_len = flc->buf_pos = 0;
+	}
+	flc->cache = 0;
+	flc->cache_bits = 0;
+	flc->fake = 0;
+}
+
+// Read more of file into buffer, returns zero at the end of the file
+static unsigned int fill_buffer(flac_t flc){
+	flc->buf_off += flc->buf_len;
+	if(flc->ra){
+		flc->buf_len = readahead_get(flc->ra, flc->buf_off, &flc->buf);
+	}else{
+		flc->buf_len = fread(flc->block, 1, FLAC_BUFSIZE, flc->fl);
+	}
+	flc->buf_pos = 0;
+	return flc->buf_len;
+}
+
+// Fill cache with at least 57 bits, using zeros after the end of the file
+static inline void refill(flac_t flc){
+	uint64_t byte;
+	while(flc->cache_bits <= 56){
+		if(flc->buf_pos < flc->buf_len || fill_buffer(flc)){
+			byte = flc->buf[flc->buf_pos++];
+		}else{
+			byte = 0;
+			flc->fake++;
+		}
+		flc->cache |= byte << (56 - flc->cache_bits);
+		flc->cache_bits += 8;
+	}
+}
+
+// Read `n` bits as unsigned integer, `n` must be at most 32
+static inline uint32_t get_bits(flac_t flc, int n){
+	if(n == 0) return 0;
+	refill(flc);
+	uint32_t val = flc->cache >> (64 - n);
+	flc->cache <<= n;
+	flc->cache_bits -= n;
+	return val;
+}
+
+// Read `n` bits as two's complement integer
+static inline int32_t get_sbits(flac_t flc, int n){
+	if(n == 0) return 0;
+	return (int32_t)(get_bits(flc, n) << (32 - n)) >> (32 - n);
+}
+
+// Count zeros before the next one bit and skip past it
+static inline uint32_t get_unary(flac_t flc){
+	uint32_t count = 0;
+	int zeros;
+	for(;;){
+		refill(flc);
+		zeros = flc->cache ? __builtin_clzll(flc->cache) : 64;
+		if(zeros < flc->cache_bits){
+			count += zeros;
+			flc->cache = zeros < 63 ? flc->cache << (zeros + 1) : 0;
+			flc->cache_bits -= zeros + 1;
+			return count;
+		}
+	
+		// Every cached bit is zero
+		count += flc->cache_bits;
+		flc->cache = 0;
+		flc->cache_bits = 0;
+		if(flc->fake > 8) return count;  // Stream ended
+	}
+}
+
+// Discard bits up to the next byte boundary
+static void align(flac_t flc){
+	get_bits(flc, flc->cache_bits % 8);
+}
+
+// Read byte of frame header and include it in CRC-8
+static unsigned int header_byte(flac_t flc){
+	unsigned int byte = get_bits(flc, 8);
+	flc->crc ^= byte;
+	for(int i = 0; i < 8; i++) flc->crc = flc->crc & 0x80 ? (flc->crc << 1) ^ 0x07 : flc->crc << 1;
+	return byte;
+}
+
+
+
+flac_t open_flac(FILE *fl, flac_err *err){
+	char magic[4];
+	if(fread(magic, 1, 4, fl) != 4 || strncmp(magic, "fLaC", 4) != 0){
+		*err = FLAC_NOT_FLAC;
+		return NULL;
+	}
+	
+	flac_t flc = calloc(1, sizeof(struct flac_s));
+	flc->fl = fl;
+	flc->buf = flc->block = malloc(FLAC_BUFSIZE);
+	flc->buf_off = 4;
+	
+	// Loop through metadata blocks
+	int last = 0, has_info = 0;
+	unsigned int type, len, i;
+	long start;
+	seekpoint_t point;
+	while(!last){
+		last = get_bits(flc, 1);
+		type = get_bits(flc, 7);
+		len = get_bits(flc, 24);
+		if(flc->fake) break;
+		start = tell(flc);
+	
+		if(type == 0 && len >= 34){  // STREAMINFO
+			flc->min_blksize = get_bits(flc, 16);
+			flc->max_blksize = get_bits(flc, 16);
+			get_bits(flc, 24);  // Minimum and maximum frame size
+			get_bits(flc, 24);
+			flc->sample_freq = get_bits(flc, 20);
+			flc->channels = get_bits(flc, 3) + 1;
+			flc->bits = get_bits(flc, 5) + 1;
+			flc->sample_count = (uint64_t)get_bits(flc, 4) << 32;
+			flc->sample_count |= get_bits(flc, 32);
+			has_info = 1;
+		}else if(type == 3){  // SEEKTABLE
+			free(flc->points);
+			flc->points = malloc(sizeof(seekpoint_t) * (len / 18 + 1));
+			flc->point_count = 0;
+			for(i = 0; i < len / 18; i++){
+				point.sample = (uint64_t)get_bits(flc, 32) << 32;
+				point.sample |= get_bits(flc, 32);
+				point.offset = (uint64_t)get_bits(flc, 32) << 32;
+				point.offset |= get_bits(flc, 32);
+				get_bits(flc, 16);  // Number of samples in frame
+	
+				// Skip placeholders
+				if(point.sample != UINT64_MAX) flc->points[flc->point_count++] = point;
+			}
+		}
+	
+		seek_to(flc, start + len);
+	}
+	flc->first_frame = tell(flc);
+	
+	if(!has_info){
+		*err = FLAC_NO_STREAMINFO;
+		free_flac(flc);
+		return NULL;
+	}
+	// Streams with unknown length or samples too large to decode into 32 bits
+	if(flc->sample_count == 0 || flc->sample_freq == 0 || flc->bits > FLAC_MAX_BITS || flc->max_blksize < 16){
+		*err = FLAC_UNSUPPORTED;
+		free_flac(flc);
+		return NULL;
+	}
+	
+	flc->samples = malloc(sizeof(int32_t) * flc->max_blksize * flc->channels);
+	flc->frame_len = 0;
+	*err = FLAC_OK;
+	return flc;
+}
+
+void free_flac(flac_t flc){
+	if(!flc) return;
+	free_readahead(flc->ra);
+	fclose(flc->fl);
+	free(flc->samples);
+	free(flc->points);
+	free(flc->block);
+	free(flc);
+}
+
+
+
+unsigned int flac_sample_freq(flac_t flc){
+	return flc->sample_freq;
+}
+
+unsigned int flac_channels(flac_t flc){
+	return flc->channels;
+}
+
+unsigned int flac_bits(flac_t flc){
+	return flc->bits;
+}
+
+uint64_t flac_sample_count(flac_t flc){
+	return flc->sample_count;
+}
+
+
+
+void flac_read_ahead(flac_t flc, unsigned int samples){
+	if(flc->ra) return;
+	
+	// Estimate bytes needed from the average size of a sample in the file
+	struct stat info;
+	double bytes = FLAC_BUFSIZE;
+	if(fstat(fileno(flc->fl), &info) == 0 && info.st_size > flc->first_frame){
+		bytes = (double)samples * (info.st_size - flc->first_frame) / flc->sample_count;
+	}
+	
+	// One more block is held while it is decoded
+	unsigned int blocks = (unsigned int)(bytes / FLAC_BUFSIZE) + 2;
+	flc->ra = make_readahead(fileno(flc->fl), FLAC_BUFSIZE, blocks, flc->buf_off + flc->buf_len);
+}
+
+int flac_read_stats(flac_t flc, unsigned long *blocks, unsigned long *stalls){
+	if(!flc->ra) return -1;
+	*blocks = readahead_blocks(flc->ra);
+	*stalls = readahead_stalls(flc->ra);
+	return 0;
+}
+
+
+
+// Read residual of `count` samples following `order` warm-up samples into `res`
+static int read_residual(flac_t flc, int32_t *res, unsigned int count, unsigned int order){
+	unsigned int method = get_bits(flc, 2);
+	if(method > 1) return -1;
+	unsigned int param_bits = method ? 5 : 4;
+	unsigned int escape = (1 << param_bits) - 1;
+	
+	unsigned int part_order = get_bits(flc, 4);
+	unsigned int part_len = count >> part_order;
+	if(part_len << part_order != count || part_len < order) return -1;
+	
+	unsigned int param, bits, n, i;
+	uint32_t val;
+	for(unsigned int p = 0; p < 1u << part_order; p++){
+		n = p == 0 ? part_len - order : part_len;
+		param = get_bits(flc, param_bits);
+		if(param == escape){
+			// Partition is stored unencoded
+			bits = get_bits(flc, 5);
+			for(i = 0; i < n; i++) *res++ = get_sbits(flc, bits);
+		}else{
+			// Rice coded with zig-zag sign
+			for(i = 0; i < n; i++){
+				val = get_unary(flc) << param;
+				val |= get_bits(flc, param);
+				*res++ = (int32_t)(val >> 1) ^ -(int32_t)(val & 1);
+			}
+		}
+	}
+	return 0;
+}
+
+// Decode subframe of `count` samples each with `bits` bits into `out`
+static int read_subframe(flac_t flc, int32_t *out, unsigned int count, unsigned int bits){
+	if(get_bits(flc, 1)) return -1;  // Padding must be zero
+	unsigned int type = get_bits(flc, 6);
+	unsigned int wasted = get_bits(flc, 1) ? get_unary(flc) + 1 : 0;
+	if(wasted >= bits) return -1;
+	bits -= wasted;
+	
+	unsigned int order, i, j;
+	if(type == 0){  // Constant
+		int32_t val = get_sbits(flc, bits);
+		for(i = 0; i < count; i++) out[i] = val;
+	
+	}else if(type == 1){  // Verbatim
+		for(i = 0; i < count; i++) out[i] = get_sbits(flc, bits);
+	
+	}else if(type >= 8 && type <= 12){  // Fixed polynomial predictor
+		order = type - 8;
+		if(order > count) return -1;
+		for(i = 0; i < order; i++) out[i] = get_sbits(flc, bits);
+		if(read_residual(flc, out + order, count, order)) return -1;
+	
+		switch(order){
+			case 1:
+				for(i = 1; i < count; i++) out[i] += out[i - 1];
+			break;
+			case 2:
+				for(i = 2; i < count; i++) out[i] += 2 * out[i - 1] - out[i - 2];
+			break;
+			case 3:
+				for(i = 3; i < count; i++) out[i] += 3 * (out[i - 1] - out[i - 2]) + out[i - 3];
+			break;
+			case 4:
+				for(i = 4; i < count; i++) out[i] += 4 * (out[i - 1] + out[i - 3]) - 6 * out[i - 2] - out[i - 4];
+			break;
+		}
+	
+	}else if(type >= 32){  // Linear predictor
+		order = type - 31;
+		if(order > count) return -1;
+		for(i = 0; i < order; i++) out[i] = get_sbits(flc, bits);
+	
+		unsigned int precision = get_bits(flc, 4) + 1;
+		if(precision == 16) return -1;
+		int shift = get_sbits(flc, 5);
+		if(shift < 0) return -1;
+		int32_t coefs[FLAC_MAX_ORDER];
+		for(i = 0; i < order; i++) coefs[i] = get_sbits(flc, precision);
+		if(read_residual(flc, out + order, count, order)) return -1;
+	
+		int64_t sum;
+		for(i = order; i < count; i++){
+			sum = 0;
+			for(j = 0; j < order; j++) sum += (int64_t)coefs[j] * out[i - 1 - j];
+			out[i] += (int32_t)(sum >> shift);
+		}
+	
+	}else{
+		return -1;  // Reserved
+	}
+	
+	if(wasted){
+		for(i = 0; i < count; i++) out[i] = (int32_t)((uint32_t)out[i] << wasted);
+	}
+	return 0;
+}
+
+// Move to the next byte which could start a frame, returns non-zero at the end of the file
+static int find_sync(flac_t flc){
+	align(flc);
+	seek_to(flc, tell(flc));  // Empty cache so buffer can be searched directly
+	
+	const uint8_t *sync;
+	for(;;){
+		if(flc->buf_pos < flc->buf_len && (sync = memchr(flc->buf + flc->buf_pos, 0xff, flc->buf_len - flc->buf_pos))){
+			flc->buf_pos = sync - flc->buf;
+			return 0;
+		}
+		if(!fill_buffer(flc)) return -1;
+	}
+}
+
+// Read frame header, returns non-zero if it is not valid or its first sample is not in [from, to]
+static int read_header(flac_t flc, uint64_t from, uint64_t to, unsigned int *chnl_code){
+	static const unsigned int sizes[8] = {0, 8, 12, 0, 16, 20, 24, 32};
+	unsigned int byte, extra, i;
+	
+	flc->crc = 0;
+	if(header_byte(flc) != 0xff) return -1;
+	byte = header_byte(flc);
+	if((byte & 0xfe) != 0xf8) return -1;
+	int variable = byte & 1;  // Whether frame is numbered by sample instead of by frame
+	
+	byte = header_byte(flc);
+	unsigned int blk_code = byte >> 4, rate_code = byte & 0x0f;
+	byte = header_byte(flc);
+	*chnl_code = byte >> 4;
+	unsigned int bits_code = (byte >> 1) & 0x07;
+	if((byte & 1) || blk_code == 0 || rate_code == 15 || bits_code == 3 || *chnl_code > 10) return -1;
+	
+	// Number is coded like UTF-8 with up to 36 bits
+	uint64_t num = header_byte(flc);
+	if(num < 0x80) extra = 0;
+	else if(num < 0xc0) return -1;
+	else if(num < 0xe0){ extra = 1; num &= 0x1f; }
+	else if(num < 0xf0){ extra = 2; num &= 0x0f; }
+	else if(num < 0xf8){ extra = 3; num &= 0x07; }
+	else if(num < 0xfc){ extra = 4; num &= 0x03; }
+	else if(num < 0xfe){ extra = 5; num &= 0x01; }
+	else if(num < 0xff){ extra = 6; num = 0; }
+	else return -1;
+	for(i = 0; i < extra; i++){
+		byte = header_byte(flc);
+		if((byte & 0xc0) != 0x80) return -1;
+		num = (num << 6) | (byte & 0x3f);
+	}
+	
+	unsigned int blksize;
+	if(blk_code == 1) blksize = 192;
+	else if(blk_code <= 5) blksize = 576 << (blk_code - 2);
+	else if(blk_code == 6) blksize = header_byte(flc) + 1;
+	else if(blk_code == 7){
+		blksize = header_byte(flc) << 8;
+		blksize = (blksize | header_byte(flc)) + 1;
+	}else blksize = 256 << (blk_code - 8);
+	
+	// Sampling frequency is taken from STREAMINFO
+	if(rate_code == 12) header_byte(flc);
+	else if(rate_code == 13 || rate_code == 14){
+		header_byte(flc);
+		header_byte(flc);
+	}
+	
+	uint8_t crc = flc->crc;
+	if(get_bits(flc, 8) != crc) return -1;
+	
+	// Sample size and channels must not change within stream
+	if((bits_code && sizes[bits_code] != flc->bits) || (*chnl_code < 8 ? *chnl_code + 1 : 2) != flc->channels) return -1;
+	if(blksize > flc->max_blksize) return -1;
+	
+	uint64_t start = variable ? num : num * flc->max_blksize;
+	if(start < from || start > to) return -1;
+	
+	flc->frame_start = start;
+	flc->frame_len = blksize;
+	flc->decoded = 0;
+	return 0;
+}
+
+// Decode samples of frame following its header
+static int read_body(flac_t flc, unsigned int chnl_code){
+	unsigned int count = flc->frame_len, c, i;
+	int side;
+	for(c = 0; c < flc->channels; c++){
+		// Side channel is stored with an extra bit
+		side = chnl_code == 9 ? c == 0 : chnl_code >= 8 && c == 1;
+		if(read_subframe(flc, flc->samples + c * flc->max_blksize, count, flc->bits + side)) return -1;
+	}
+	align(flc);
+	get_bits(flc, 16);  // CRC-16 of frame is not checked
+	if(flc->fake * 8 > (unsigned int)flc->cache_bits) return -1;  // Frame was cut off by the end of the file
+	
+	// Undo stereo decorrelation
+	int32_t *left = flc->samples, *right = flc->samples + flc->max_blksize, mid;
+	switch(chnl_code){
+		case 8:  // Left and side
+			for(i = 0; i < count; i++) right[i] = left[i] - right[i];
+		break;
+		case 9:  // Side and right
+			for(i = 0; i < count; i++) left[i] += right[i];
+		break;
+		case 10:  // Mid and side
+			for(i = 0; i < count; i++){
+				mid = (int32_t)((uint32_t)left[i] << 1) | (right[i] & 1);
+				left[i] = (mid + right[i]) >> 1;
+				right[i] = (mid - right[i]) >> 1;
+			}
+		break;
+	}
+	return 0;
+}
+
+// Read the next frame starting within [from, max(from, sampidx)], skipping anything else
+// Only the samples of the frame containing `sampidx` are decoded, others are passed over after their header
+// Returns non-zero at the end of the file
+static int read_frame(flac_t flc, uint64_t from, uint64_t sampidx){
+	long start;
+	unsigned int chnl_code;
+	for(;;){
+		if(find_sync(flc)) return -1;
+		start = tell(flc);
+		
+		if(!read_header(flc, from, sampidx > from ? sampidx : from, &chnl_code)){
+			if(sampidx - flc->frame_start >= flc->frame_len) return 0;
+			
+			// Damaged frames are silent so that the frames after them are still found
+			if(read_body(flc, chnl_code)){
+				memset(flc->samples, 0, sizeof(int32_t) * flc->max_blksize * flc->channels);
+			}
+			flc->decoded = 1;
+			return 0;
+		}
+		
+		// Search again from the next byte
+		seek_to(flc, start + 1);
+	}
+}
+
+// Make the frame containing `sampidx` the current frame
+static int load_frame(flac_t flc, uint64_t sampidx){
+	if(sampidx >= flc->sample_count) return -1;
+	
+	// Find last seek point at or before sample
+	unsigned int low = 0, high = flc->point_count, mid;
+	while(low < high){
+		mid = (low + high) / 2;
+		if(flc->points[mid].sample <= sampidx) low = mid + 1;
+		else high = mid;
+	}
+	seekpoint_t *point = low > 0 ? flc->points + low - 1 : NULL;
+	
+	// Continue after the current frame unless the sample is before it or a seek point is closer
+	uint64_t from, end = flc->frame_start + flc->frame_len;
+	if(flc->decoded && sampidx >= end && !(point && point->sample > end)){
+		from = end;
+	}else if(point){
+		seek_to(flc, flc->first_frame + point->offset);
+		from = point->sample;
+	}else{
+		seek_to(flc, flc->first_frame);
+		from = 0;
+	}
+	
+	while(!read_frame(flc, from, sampidx)){
+		if(flc->decoded) return 0;
+		from = flc->frame_start + flc->frame_len;
+	}
+	flc->frame_len = 0;
+	flc->decoded = 0;
+	return -1;
+}
+
+const int32_t *flac_sampat(flac_t flc, uint64_t sampidx, int chnl){
+	if(chnl < 0 || (unsigned int)chnl >= flc->channels) return NULL;
+	if(!flc->decoded || sampidx - flc->frame_start >= flc->frame_len){
+		if(load_frame(flc, sampidx)) return NULL;
+	}
+	return flc->samples + chnl * flc->max_blksize + (sampidx - flc->frame_start);
+}
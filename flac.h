@@ -0,0 +1,42 @@
+#ifndef _FLAC_H
+#define _FLAC_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+struct flac_s;
+typedef struct flac_s *flac_t;
+
+typedef enum{
+	FLAC_OK = 0,
+	FLAC_NOT_FLAC,
+	FLAC_NO_STREAMINFO,
+	FLAC_UNSUPPORTED
+} flac_err;
+
+// Read metadata of FLAC stream from file stream, which is kept open to decode frames on demand
+// File stream is closed by `free_flac`
+flac_t open_flac(FILE *fl, flac_err *err);
+void free_flac(flac_t flc);
+
+// Get sampling frequency of stream
+unsigned int flac_sample_freq(flac_t flc);
+// Get number of channels in stream
+unsigned int flac_channels(flac_t flc);
+// Get number of bits in each sample
+unsigned int flac_bits(flac_t flc);
+// Get number of samples in each channel of stream
+uint64_t flac_sample_count(flac_t flc);
+
+// Read file on a helper thread from now on, keeping enough of it buffered to decode about `samples` samples ahead
+void flac_read_ahead(flac_t flc, unsigned int samples);
+// Get number of blocks read ahead which were used and how many of them were not ready in time
+// Returns non-zero when file is not being read ahead
+int flac_read_stats(flac_t flc, unsigned long *blocks, unsigned long *stalls);
+
+// Get pointer to sample `sampidx` of channel `chnl` within the decoded frame containing it
+// Decodes frames forward from the current one, or from the closest seek point before it, until it is found
+// Returns NULL if sample could not be decoded
+const int32_t *flac_sampat(flac_t flc, uint64_t sampidx, int chnl);
+
+#endif
@@ -1,33 +1,78 @@
 #include <math.h>
+#include <complex.h>
+#include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <unistd.h>
 
 #include "fourier.h"
 
 #define MATH_PI 3.141592653589793
 
+// Number of independent partial sums used when adding runs of samples
+// Single precision storage is paired with more lanes to keep the wider accumulators busy
+#ifdef SPECTRO_FLOAT32
+#define SUM_LANES 4
+#else
+#define SUM_LANES 1
+#endif
+
+// Minimum number of samples stored for the wave data of a table
+#define WAVE_MIN_RUN 64
+
 
 struct freqtbl_s {
 	double frequency;
 	
 	// Read-Only Variables for storing wave data
 	int cycles, samples;  // Number of cycles and samples in block (wave data)
-	// Arrays of doubles representing samples of sin and cos within block
-	double *sine, *cosine;
+	int wavelen;  // Number of samples stored for waves, a multiple of the block
+	// Arrays representing samples of sin and cos within block
+	sample_t *sine, *cosine;
 	
 	// Variables used during calculation of running sums
 	int blkidx;  // Location within block (wave data)
 	int winwidth, winidx;  // Size of window and current location within window
 	// NOTE: winwidth < 0 used to indicate infinite window
 	int samps_in_win;  // Number of samples in window currently
-	double *window;  // Store prior samples
+	sample_t *window;  // Store prior samples
 	
 	// Keep track of running sums and norms
+	// Samples only leave the window from these sums, which are replaced by the fresh sums once
+	// every sample they contain has left, so rounding error from removals cannot build up
 	double sine_sum, cosine_sum;
 	double sine_norm, cosine_norm;
+	int stale_count;  // Number of samples in window included in the sums above
+	// Sums of the samples added since the sums above were last replaced
+	// Split into lanes which sample `n` of the fresh sums is added to lane `n % SUM_LANES` of,
+	// so their total does not depend on how samples were split between calls
+	double fresh_sine_sum[SUM_LANES], fresh_cosine_sum[SUM_LANES];
+	double fresh_sine_norm[SUM_LANES], fresh_cosine_norm[SUM_LANES];
+	int fresh_lane;  // Lane which the next sample is added to
+	int fresh_count;  // Number of samples included in fresh sums
 };
 
 
+// Empty the fresh sums
+static void reset_fresh(freqtbl_t tbl){
+	for(int l = 0; l < SUM_LANES; l++){
+		tbl->fresh_sine_sum[l] = 0;
+		tbl->fresh_sine_norm[l] = 0;
+		tbl->fresh_cosine_sum[l] = 0;
+		tbl->fresh_cosine_norm[l] = 0;
+	}
+	tbl->fresh_lane = 0;
+	tbl->fresh_count = 0;
+}
+
+// Add up the lanes of a fresh sum
+static double lanes_total(const double *lanes){
+	double total = lanes[0];
+	for(int l = 1; l < SUM_LANES; l++) total += lanes[l];
+	return total;
+}
+
+
 // Initialize memory of frequency table pointed to by `tbl`
 static freqtbl_t fill_freqtbl(freqtbl_t tbl, double sample_freq, int samples_perblk, int cycles_perblk){
 	// Frequencies greater than sample_freq are unresolvable
@@ -39,13 +84,19 @@ static freqtbl_t fill_freqtbl(freqtbl_t tbl, double sample_freq, int samples_per
 	tbl->samples = samples_perblk;
 	
 	// Generate waves
-	tbl->sine = malloc(sizeof(double) * samples_perblk);
-	tbl->cosine = malloc(sizeof(double) * samples_perblk);
+	// Short blocks are repeated so that runs of samples can be added without wrapping every few samples
+	tbl->wavelen = samples_perblk * ((WAVE_MIN_RUN + samples_perblk - 1) / samples_perblk);
+	tbl->sine = malloc(sizeof(sample_t) * tbl->wavelen);
+	tbl->cosine = malloc(sizeof(sample_t) * tbl->wavelen);
 	double radians_persamp = 2 * MATH_PI * cycles_perblk / samples_perblk;
 	for(int i = 0; i < samples_perblk; i++){
 		tbl->sine[i] = sin(i * radians_persamp);
 		tbl->cosine[i] = cos(i * radians_persamp);
 	}
+	for(int i = samples_perblk; i < tbl->wavelen; i++){
+		tbl->sine[i] = tbl->sine[i - samples_perblk];
+		tbl->cosine[i] = tbl->cosine[i - samples_perblk];
+	}
 	
 	// Initialize variables that will be used for accumulation
 	tbl->blkidx = 0;
@@ -58,6 +109,8 @@ static freqtbl_t fill_freqtbl(freqtbl_t tbl, double sample_freq, int samples_per
 	tbl->sine_norm = 0;
 	tbl->cosine_sum = 0;
 	tbl->cosine_norm = 0;
+	tbl->stale_count = 0;
+	reset_fresh(tbl);
 	
 	return tbl;
 }
@@ -131,7 +184,7 @@ void init_freqtbl(freqtbl_t tbl, int samples_perwin){
 	if(samples_perwin <= 0){
 		tbl->window = NULL;
 	}else{
-		tbl->window = malloc(sizeof(double) * tbl->winwidth);
+		tbl->window = malloc(sizeof(sample_t) * tbl->winwidth);
 	}
 }
 
@@ -151,28 +204,50 @@ void clear_freqtbl(freqtbl_t tbl){
 	tbl->sine_norm = 0;
 	tbl->cosine_sum = 0;
 	tbl->cosine_norm = 0;
+	tbl->stale_count = 0;
+	reset_fresh(tbl);
 }
 
 
 
 double freqtbl_get(freqtbl_t tbl){
-	if(tbl->samps_in_win >= tbl->winwidth && tbl->sine_norm > 0 && tbl->cosine_norm > 0){
-		return hypot(tbl->sine_sum / tbl->sine_norm, tbl->cosine_sum / tbl->cosine_norm);
+	double sine_norm = tbl->sine_norm + lanes_total(tbl->fresh_sine_norm);
+	double cosine_norm = tbl->cosine_norm + lanes_total(tbl->fresh_cosine_norm);
+	if(tbl->samps_in_win >= tbl->winwidth && sine_norm > 0 && cosine_norm > 0){
+		return hypot(
+			(tbl->sine_sum + lanes_total(tbl->fresh_sine_sum)) / sine_norm,
+			(tbl->cosine_sum + lanes_total(tbl->fresh_cosine_sum)) / cosine_norm
+		);
 	}else{
 		return -1;
 	}
 }
 
+// Called before removing a sample from the window once every sample of the stale sums has left
+// Whatever remains of the stale sums is rounding error, so they are replaced by the fresh sums
+static void freqtbl_rebase(freqtbl_t tbl){
+	tbl->sine_sum = lanes_total(tbl->fresh_sine_sum);
+	tbl->sine_norm = lanes_total(tbl->fresh_sine_norm);
+	tbl->cosine_sum = lanes_total(tbl->fresh_cosine_sum);
+	tbl->cosine_norm = lanes_total(tbl->fresh_cosine_norm);
+	tbl->stale_count = tbl->fresh_count;
+	
+	reset_fresh(tbl);
+}
+
 void freqtbl_push(freqtbl_t tbl, double sample){
 	double s, c;
+	int l = tbl->fresh_lane;
 	
 	// Include new sample in the running sums
 	s = tbl->sine[tbl->blkidx];
-	tbl->sine_sum += s * sample;
-	tbl->sine_norm += s * s;
+	tbl->fresh_sine_sum[l] += s * sample;
+	tbl->fresh_sine_norm[l] += s * s;
 	c = tbl->cosine[tbl->blkidx];
-	tbl->cosine_sum += c * sample;
-	tbl->cosine_norm += c * c;
+	tbl->fresh_cosine_sum[l] += c * sample;
+	tbl->fresh_cosine_norm[l] += c * c;
+	tbl->fresh_lane = (l + 1) % SUM_LANES;
+	if(tbl->winwidth > 0) tbl->fresh_count++;
 	
 	// Remove samples that are no longer in the scope of the window from the sine and cosine sums
 	// Only occurs in finite mode
@@ -182,6 +257,8 @@ void freqtbl_push(freqtbl_t tbl, double sample){
 		if(oldidx < 0) oldidx += tbl->samples;
 		
 		// Remove oldest sample from the running sums
+		if(tbl->stale_count == 0) freqtbl_rebase(tbl);
+		tbl->stale_count--;
 		s = tbl->sine[oldidx];
 		tbl->sine_sum -= s * tbl->window[tbl->winidx];
 		tbl->sine_norm -= s * s;
@@ -203,9 +280,11 @@ void freqtbl_push(freqtbl_t tbl, double sample){
 	tbl->blkidx %= tbl->samples;
 }
 
-// Moves window forward by multiple samples
-void freqtbl_pushall(freqtbl_t tbl, unsigned int count, double *samples){
+// Remove the samples which leave the window when `count` more samples are pushed
+// Returns the number of leading samples which would leave the window immediately and should be skipped
+static unsigned int freqtbl_slide(freqtbl_t tbl, unsigned int count){
 	double s, c;
+	unsigned int skip = 0;
 	
 	// If Window is unbounded
 	if(tbl->winwidth <= 0){
@@ -218,15 +297,16 @@ void freqtbl_pushall(freqtbl_t tbl, unsigned int count, double *samples){
 		tbl->sine_norm = 0;
 		tbl->cosine_sum = 0;
 		tbl->cosine_norm = 0;
+		tbl->stale_count = 0;
+		reset_fresh(tbl);
 		
 		tbl->winidx = 0;
 		tbl->samps_in_win = tbl->winwidth;
 		
 		// Ignore excess samples
-		samples += count - tbl->winwidth;
-		tbl->blkidx += count - tbl->winwidth;
+		skip = count - tbl->winwidth;
+		tbl->blkidx += skip;
 		tbl->blkidx %= tbl->samples;
-		count = tbl->winwidth;
 		
 	// If extra samples won't fill window
 	}else if(count + tbl->samps_in_win <= tbl->winwidth){
@@ -239,6 +319,8 @@ void freqtbl_pushall(freqtbl_t tbl, unsigned int count, double *samples){
 		tbl->sine_norm = 0;
 		tbl->cosine_sum = 0;
 		tbl->cosine_norm = 0;
+		tbl->stale_count = 0;
+		reset_fresh(tbl);
 		
 		// Refill window
 		tbl->samps_in_win = tbl->winwidth - count;  // Use samps_in_win to count backwards
@@ -262,8 +344,9 @@ void freqtbl_pushall(freqtbl_t tbl, unsigned int count, double *samples){
 		
 		// Move indices back to correct position
 		tbl->blkidx = (tbl->blkidx + tbl->winwidth - count) % tbl->samples;
-		tbl->winidx = (tbl->winidx - count) % tbl->winwidth ;
+		tbl->winidx = (tbl->winidx + tbl->winwidth - count) % tbl->winwidth;
 		tbl->samps_in_win = tbl->winwidth;
+		tbl->stale_count = tbl->winwidth - count;
 		
 	// If less than half of window will be replaced
 	}else{
@@ -277,6 +360,8 @@ void freqtbl_pushall(freqtbl_t tbl, unsigned int count, double *samples){
 		tbl->samps_in_win = tbl->samps_in_win + count - tbl->winwidth;  // Use samps_in_win to track how many removals left
 		while(tbl->samps_in_win > 0){
 			// Remove values from sums
+			if(tbl->stale_count == 0) freqtbl_rebase(tbl);
+			tbl->stale_count--;
 			s = tbl->sine[tbl->blkidx];
 			tbl->sine_sum -= s * tbl->window[tbl->winidx];
 			tbl->sine_norm -= s * s;
@@ -296,30 +381,104 @@ void freqtbl_pushall(freqtbl_t tbl, unsigned int count, double *samples){
 		tbl->samps_in_win = tbl->winwidth;
 	}
 	
-	// Add new samples
-	for(; count > 0; count--, samples++){
-		// Include new sample in the running sums
-		s = tbl->sine[tbl->blkidx];
-		tbl->sine_sum += s * (*samples);
-		tbl->sine_norm += s * s;
-		c = tbl->cosine[tbl->blkidx];
-		tbl->cosine_sum += c * (*samples);
-		tbl->cosine_norm += c * c;
+	return skip;
+}
+
+// Include `count` samples into the running sums and window
+// Window must already have space for them from `freqtbl_slide`
+static void freqtbl_append(freqtbl_t tbl, unsigned int count, const sample_t *samples){
+	// Keep lanes of fresh sums in locals so they are not written back for every sample
+	// Sums are split into independent lanes so consecutive samples can be accumulated in parallel
+	double ss[SUM_LANES], sn[SUM_LANES], cs[SUM_LANES], cn[SUM_LANES];
+	const sample_t *sine, *cosine;
+	double s, c;
+	unsigned int run, i, l, lane = tbl->fresh_lane;
+	for(l = 0; l < SUM_LANES; l++){
+		ss[l] = tbl->fresh_sine_sum[l];
+		sn[l] = tbl->fresh_sine_norm[l];
+		cs[l] = tbl->fresh_cosine_sum[l];
+		cn[l] = tbl->fresh_cosine_norm[l];
+	}
+	
+	// Add samples to window in runs that do not wrap around
+	if(tbl->winwidth > 0){
+		const sample_t *src = samples;
+		for(i = count; i > 0; i -= run, src += run){
+			run = tbl->winwidth - tbl->winidx;
+			if(run > i) run = i;
+			memcpy(tbl->window + tbl->winidx, src, sizeof(sample_t) * run);
+			tbl->winidx += run;
+			if(tbl->winidx >= tbl->winwidth) tbl->winidx = 0;
+		}
+	}
+	
+	if(tbl->winwidth > 0) tbl->fresh_count += count;
+	
+	// Include new samples in the running sums in runs that do not wrap around the block
+	while(count > 0){
+		run = tbl->wavelen - tbl->blkidx;
+		if(run > count) run = count;
+		sine = tbl->sine + tbl->blkidx;
+		cosine = tbl->cosine + tbl->blkidx;
 		
-		// Add sample to window
-		if(tbl->winwidth > 0){
-			tbl->window[tbl->winidx] = *samples;
-			tbl->winidx++;
-			tbl->winidx %= tbl->winwidth;
+		// Samples before the next first lane, whole groups of lanes, then the rest
+		for(i = 0; i < run && lane != 0; i++, lane = (lane + 1) % SUM_LANES){
+			s = sine[i];
+			ss[lane] += s * samples[i];
+			sn[lane] += s * s;
+			c = cosine[i];
+			cs[lane] += c * samples[i];
+			cn[lane] += c * c;
+		}
+		for(; i + SUM_LANES <= run; i += SUM_LANES){
+			for(l = 0; l < SUM_LANES; l++){
+				s = sine[i + l];
+				ss[l] += s * samples[i + l];
+				sn[l] += s * s;
+				c = cosine[i + l];
+				cs[l] += c * samples[i + l];
+				cn[l] += c * c;
+			}
+		}
+		for(; i < run; i++, lane++){
+			s = sine[i];
+			ss[lane] += s * samples[i];
+			sn[lane] += s * s;
+			c = cosine[i];
+			cs[lane] += c * samples[i];
+			cn[lane] += c * c;
 		}
 		
-		tbl->blkidx++;
-		tbl->blkidx %= tbl->samples;
+		samples += run;
+		count -= run;
+		tbl->blkidx = (tbl->blkidx + run) % tbl->samples;
 	}
+	
+	for(l = 0; l < SUM_LANES; l++){
+		tbl->fresh_sine_sum[l] = ss[l];
+		tbl->fresh_sine_norm[l] = sn[l];
+		tbl->fresh_cosine_sum[l] = cs[l];
+		tbl->fresh_cosine_norm[l] = cn[l];
+	}
+	tbl->fresh_lane = lane;
+}
+
+// Moves window forward by multiple samples
+void freqtbl_pushall(freqtbl_t tbl, unsigned int count, sample_t *samples){
+	unsigned int skip = freqtbl_slide(tbl, count);
+	freqtbl_append(tbl, count - skip, samples + skip);
 }
 
 
 
+unsigned int freqtbl_samps_perblk(freqtbl_t tbl){
+	return tbl->samples;
+}
+
+unsigned int freqtbl_samps_perwin(freqtbl_t tbl){
+	return tbl->winwidth > 0 ? tbl->winwidth : 0;
+}
+
 double freqtbl_freq(freqtbl_t tbl){
 	return tbl->frequency;
 }
@@ -328,15 +487,312 @@ double freqtbl_freq(freqtbl_t tbl){
 
 
 
+/* Frequency List
+ * Each frequency keeps a phasor e^(i * phase) which is rotated every sample instead of a
+ * table of wave data. All frequencies share one window of the same width W, so the sample
+ * leaving the window is the same for every frequency and its phase is that of the current
+ * phasor rotated back by W samples. State is stored as arrays over the frequencies so the
+ * inner loop over frequencies can be vectorized.
+ */
+#define FREQLIST_BLOCK 128  // Number of frequencies updated together over a run of samples
+
+struct freqlist_s {
+	unsigned int count, padded;  // Number of frequencies and size of arrays rounded up to whole blocks
+	double *freqs;
+	
+	// Phasor of next sample and rotation applied every sample
+	double *phs_re, *phs_im;
+	double *rot_re, *rot_im;
+	// Rotation back to the phase of the sample leaving the window
+	double *back_re, *back_im;
+	// Sum of e^(2i * phase) over window divided by square of phasor, used for norms
+	double *dbl_re, *dbl_im;
+	// Running sum of sample * e^(i * phase) over window
+	// Samples leave the window only from these sums, which are replaced by the fresh sums every
+	// `winwidth` samples once all of their samples have left, so rounding error cannot build up
+	double *sum_re, *sum_im;
+	double *fresh_re, *fresh_im;
+	
+	unsigned int winwidth, winidx;  // Size of shared window and current location within it
+	unsigned int samps_in_win;
+	unsigned int stale_count;  // Number of samples left to remove before sums are replaced
+	sample_t *window;  // Store prior samples, zero before being filled
+};
+
+
+// Width of shared window lasting `maxdur` or long enough to contain 5 cycles of the `lowest` frequency
+static unsigned int freqlist_width(double sample_freq, double lowest, double maxdur){
+	double width = maxdur * sample_freq;
+	if(lowest > 0 && width < 5 * sample_freq / lowest) width = 5 * sample_freq / lowest;
+	return width < 1 ? 1 : (unsigned int)width;
+}
+
+// Size of arrays over `count` frequencies rounded up to whole blocks
+static unsigned int freqlist_padded(unsigned int count){
+	return (count + FREQLIST_BLOCK - 1) / FREQLIST_BLOCK * FREQLIST_BLOCK;
+}
+
+// Bytes allocated by a list of `count` frequencies with a window of `winwidth` samples
+static size_t freqlist_size(unsigned int count, unsigned int winwidth){
+	return sizeof(struct freqlist_s) + sizeof(double) * (count + 12 * freqlist_padded(count)) + sizeof(sample_t) * winwidth;
+}
+
+freqlist_t gen_freqlist(double sample_freq, unsigned int count, const double *freqs, double maxdur){
+	if(count == 0) return NULL;
+	
+	freqlist_t lst = malloc(sizeof(struct freqlist_s));
+	lst->count = count;
+	lst->freqs = malloc(sizeof(double) * count);
+	memcpy(lst->freqs, freqs, sizeof(double) * count);
+	
+	double lowest = freqs[0];
+	for(unsigned int i = 1; i < count; i++) if(freqs[i] < lowest) lowest = freqs[i];
+	lst->winwidth = freqlist_width(sample_freq, lowest, maxdur);
+	lst->window = malloc(sizeof(sample_t) * lst->winwidth);
+	
+	// Padding frequencies are left at zero and never read
+	unsigned int padded = freqlist_padded(count);
+	lst->padded = padded;
+	double *arrays = malloc(sizeof(double) * padded * 12);
+	lst->phs_re = arrays;
+	lst->phs_im = arrays + padded;
+	lst->rot_re = arrays + 2 * padded;
+	lst->rot_im = arrays + 3 * padded;
+	lst->back_re = arrays + 4 * padded;
+	lst->back_im = arrays + 5 * padded;
+	lst->dbl_re = arrays + 6 * padded;
+	lst->dbl_im = arrays + 7 * padded;
+	lst->sum_re = arrays + 8 * padded;
+	lst->sum_im = arrays + 9 * padded;
+	lst->fresh_re = arrays + 10 * padded;
+	lst->fresh_im = arrays + 11 * padded;
+	
+	double w;
+	double complex dbl, rot2;
+	for(unsigned int i = 0; i < padded; i++){
+		w = i < count ? 2 * MATH_PI * freqs[i] / sample_freq : 0;  // Radians per sample
+		lst->rot_re[i] = cos(w);
+		lst->rot_im[i] = sin(w);
+		lst->back_re[i] = cos(w * lst->winwidth);
+		lst->back_im[i] = -sin(w * lst->winwidth);
+		
+		// Sum of e^(2i * w * k) for k in [-W, 0) using the geometric series
+		rot2 = cexp(2 * I * w);
+		if(cabs(rot2 - 1) < 1e-12) dbl = lst->winwidth;
+		else dbl = (1 - cpow(rot2, lst->winwidth)) / (1 - rot2) * cpow(rot2, -(double)lst->winwidth);
+		lst->dbl_re[i] = creal(dbl);
+		lst->dbl_im[i] = cimag(dbl);
+	}
+	
+	clear_freqlist(lst);
+	return lst;
+}
+
+void free_freqlist(freqlist_t lst){
+	if(!lst) return;
+	free(lst->phs_re);  // Start of all arrays over frequencies
+	free(lst->window);
+	free(lst->freqs);
+	free(lst);
+}
+
+void clear_freqlist(freqlist_t lst){
+	for(unsigned int i = 0; i < lst->padded; i++){
+		lst->phs_re[i] = 1;
+		lst->phs_im[i] = 0;
+		lst->sum_re[i] = 0;
+		lst->sum_im[i] = 0;
+		lst->fresh_re[i] = 0;
+		lst->fresh_im[i] = 0;
+	}
+	memset(lst->window, 0, sizeof(sample_t) * lst->winwidth);
+	lst->winidx = 0;
+	lst->samps_in_win = 0;
+	lst->stale_count = lst->winwidth;  // Zeros of empty window
+}
+
+
+
+unsigned int freqlist_count(freqlist_t lst){
+	return lst->count;
+}
+
+double freqlist_freq(freqlist_t lst, unsigned int i){
+	return lst->freqs[i];
+}
+
+unsigned int freqlist_samps_perwin(freqlist_t lst){
+	return lst->winwidth;
+}
+
+size_t freqlist_bytes(freqlist_t lst){
+	return lst ? freqlist_size(lst->count, lst->winwidth) : 0;
+}
+
+double freqlist_get(freqlist_t lst, unsigned int i){
+	if(lst->samps_in_win < lst->winwidth) return -1;
+	
+	// Sums of cos^2 and sin^2 over window from the sum of e^(2i * phase)
+	double pr = lst->phs_re[i], pi = lst->phs_im[i];
+	double dbl = (pr * pr - pi * pi) * lst->dbl_re[i] - 2 * pr * pi * lst->dbl_im[i];
+	double cosine_norm = (lst->winwidth + dbl) / 2;
+	double sine_norm = (lst->winwidth - dbl) / 2;
+	if(cosine_norm <= 0 || sine_norm <= 0) return -1;
+	
+	return hypot((lst->sum_im[i] + lst->fresh_im[i]) / sine_norm, (lst->sum_re[i] + lst->fresh_re[i]) / cosine_norm);
+}
+
+// Update one block of frequencies with `count` samples starting at window index `winidx`
+// Sums are replaced by the fresh sums after the first `stale` samples
+// Fixed block size lets the loop over frequencies be vectorized without a remainder
+static void freqlist_update(
+	double *restrict phs_re, double *restrict phs_im,
+	const double *restrict rot_re, const double *restrict rot_im,
+	const double *restrict back_re, const double *restrict back_im,
+	double *restrict sum_re, double *restrict sum_im,
+	double *restrict fresh_re, double *restrict fresh_im,
+	unsigned int count, const sample_t *samples,
+	const sample_t *window, unsigned int winwidth, unsigned int winidx, unsigned int stale
+){
+	double pr, pi, in, out;
+	unsigned int i;
+	for(unsigned int n = 0; n < count; n++){
+		in = samples[n];
+		out = window[(winidx + n) % winwidth];  // Sample leaving the window
+		
+		for(i = 0; i < FREQLIST_BLOCK; i++){
+			pr = phs_re[i];
+			pi = phs_im[i];
+			
+			fresh_re[i] += in * pr;
+			fresh_im[i] += in * pi;
+			sum_re[i] -= out * (pr * back_re[i] - pi * back_im[i]);
+			sum_im[i] -= out * (pr * back_im[i] + pi * back_re[i]);
+			
+			phs_re[i] = pr * rot_re[i] - pi * rot_im[i];
+			phs_im[i] = pr * rot_im[i] + pi * rot_re[i];
+		}
+		
+		// Every sample of the sums has left the window, so what remains of them is rounding error
+		if(n + 1 == stale){
+			for(i = 0; i < FREQLIST_BLOCK; i++){
+				sum_re[i] = fresh_re[i];
+				sum_im[i] = fresh_im[i];
+				fresh_re[i] = 0;
+				fresh_im[i] = 0;
+			}
+		}
+	}
+}
+
+void freqlist_pushall(freqlist_t lst, unsigned int count, sample_t *samples){
+	unsigned int i, n;
+	
+	// Only the last window of samples contributes, so rotate the phasors past the others
+	if(count >= lst->winwidth){
+		unsigned int skip = count - lst->winwidth;
+		double w, pr, pi, sr, sc;
+		for(i = 0; i < lst->count; i++){
+			w = fmod(atan2(lst->rot_im[i], lst->rot_re[i]) * skip, 2 * MATH_PI);
+			sc = cos(w);
+			sr = sin(w);
+			pr = lst->phs_re[i];
+			pi = lst->phs_im[i];
+			lst->phs_re[i] = pr * sc - pi * sr;
+			lst->phs_im[i] = pr * sr + pi * sc;
+			lst->sum_re[i] = 0;
+			lst->sum_im[i] = 0;
+			lst->fresh_re[i] = 0;
+			lst->fresh_im[i] = 0;
+		}
+		memset(lst->window, 0, sizeof(sample_t) * lst->winwidth);
+		lst->winidx = 0;
+		lst->stale_count = lst->winwidth;
+		
+		samples += skip;
+		count = lst->winwidth;
+	}
+	
+	// Update blocks of frequencies over all of the samples so their state stays in cache
+	for(i = 0; i < lst->count; i += FREQLIST_BLOCK){
+		freqlist_update(
+			lst->phs_re + i, lst->phs_im + i, lst->rot_re + i, lst->rot_im + i,
+			lst->back_re + i, lst->back_im + i, lst->sum_re + i, lst->sum_im + i,
+			lst->fresh_re + i, lst->fresh_im + i,
+			count, samples, lst->window, lst->winwidth, lst->winidx, lst->stale_count
+		);
+	}
+	// Window is at least as wide as the samples, so sums are replaced at most once
+	lst->stale_count = count >= lst->stale_count ? lst->stale_count + lst->winwidth - count : lst->stale_count - count;
+	
+	// Store samples in window
+	for(n = 0; n < count; n++){
+		lst->window[lst->winidx] = samples[n];
+		lst->winidx = (lst->winidx + 1) % lst->winwidth;
+	}
+	lst->samps_in_win = lst->samps_in_win + count < lst->winwidth ? lst->samps_in_win + count : lst->winwidth;
+	
+	// Keep phasors on the unit circle despite rounding
+	double mag;
+	for(i = 0; i < lst->count; i++){
+		mag = hypot(lst->phs_re[i], lst->phs_im[i]);
+		lst->phs_re[i] /= mag;
+		lst->phs_im[i] /= mag;
+	}
+}
+
+unsigned int freqlist_samps_needed(freqlist_t lst, unsigned int count){
+	return count < lst->winwidth ? count : lst->winwidth;
+}
+
+
+
 struct spectrum_s {
 	double lowest, highest;
 	double ratio;
+	double sample_freq, maxdur;
 	
 	struct freqtbl_s *begin, *end;  // Beginning and End of Array of frequency tables
+	unsigned int *wave_refs;  // Number of spectra sharing the wave data of the tables
+	freqlist_t lst;  // Phasors used instead of the tables by `SPEC_PHASORS`
+	double *prev;  // Amplitudes of the previous line for flux, allocated once it is requested
+	
+	// Number of tables and samples updated together by `spec_pushall`
+	unsigned int tile_bins, tile_samps;
+	unsigned int *skips;  // Samples skipped by each table during current push
 };
 
 
+// Choose tile size so that a run of samples stays in L1 cache while
+// the wave data and windows of a group of tables stay in L2 cache
+static void tune_spectrum(spectrum_t spec){
+	long l1 = sysconf(_SC_LEVEL1_DCACHE_SIZE), l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+	if(l1 <= 0) l1 = 32 * 1024;
+	if(l2 <= 0) l2 = 256 * 1024;
+	
+	// Use a quarter of L1 for samples
+	unsigned int samps = l1 / 4 / sizeof(sample_t);
+	
+	// Average bytes touched per table during one run of samples
+	unsigned long touched = 0;
+	unsigned int count = spec_freqcount(spec);
+	for(freqtbl_t tbl = spec->begin; tbl <= spec->end; tbl++){
+		touched += sizeof(sample_t) * 2 * (tbl->samples < samps ? tbl->samples : samps);  // Wave data
+		touched += sizeof(sample_t) * samps;  // Window
+	}
+	touched /= count;
+	
+	// Use half of L2 for the group of tables
+	unsigned int bins = l2 / 2 / (touched + sizeof(struct freqtbl_s));
+	spec_set_tile(spec, bins < 1 ? 1 : bins, samps);
+}
+
+
 spectrum_t gen_spectrum(double sample_freq, double low, double high, int count, double maxdur){
+	return gen_spectrum_with(SPEC_TABLES, sample_freq, low, high, count, maxdur);
+}
+
+spectrum_t gen_spectrum_with(spec_engine_t engine, double sample_freq, double low, double high, int count, double maxdur){
 	// Frequencies must be greater than zero
 	if(low <= 0 || high <= 0) return NULL;
 	// Lower bound of frequency must be higher than upper bound
@@ -348,10 +804,27 @@ spectrum_t gen_spectrum(double sample_freq, double low, double high, int count,
 	spectrum_t spec = malloc(sizeof(struct spectrum_s));
 	spec->lowest = low;
 	spec->highest = high;
+	spec->sample_freq = sample_freq;
+	spec->maxdur = maxdur;
+	spec->prev = NULL;
 	
 	count = abs(count);
 	spec->ratio = pow(high / low, 1 / (double)(count - 1));
 	
+	// Phasors track the spaced frequencies exactly
+	if(engine == SPEC_PHASORS){
+		double freqs[count];
+		freqs[0] = low;
+		for(int i = 1; i < count; i++) freqs[i] = freqs[i - 1] * spec->ratio;
+		spec->lst = gen_freqlist(sample_freq, count, freqs, maxdur);
+		spec->begin = spec->end = NULL;
+		spec->wave_refs = NULL;
+		spec->skips = NULL;
+		spec->tile_bins = spec->tile_samps = 0;
+		return spec;
+	}
+	spec->lst = NULL;
+	
 	// Allocate memory for array of frequency tables
 	spec->begin = malloc(sizeof(struct freqtbl_s) * count);
 	spec->end = spec->begin + count - 1;
@@ -366,19 +839,67 @@ spectrum_t gen_spectrum(double sample_freq, double low, double high, int count,
 		f *= spec->ratio;
 	}
 	
+	spec->skips = malloc(sizeof(unsigned int) * count);
+	spec->wave_refs = malloc(sizeof(unsigned int));
+	*spec->wave_refs = 1;
+	tune_spectrum(spec);
 	return spec;
 }
 
+spectrum_t share_spectrum(spectrum_t spec){
+	// Phasors have no wave data to share
+	if(spec->lst){
+		return gen_spectrum_with(SPEC_PHASORS, spec->sample_freq, spec->lowest, spec->highest, spec_freqcount(spec), spec->maxdur);
+	}
+	
+	unsigned int count = spec_freqcount(spec);
+	spectrum_t copy = malloc(sizeof(struct spectrum_s));
+	*copy = *spec;
+	copy->begin = malloc(sizeof(struct freqtbl_s) * count);
+	copy->end = copy->begin + count - 1;
+	memcpy(copy->begin, spec->begin, sizeof(struct freqtbl_s) * count);
+	
+	// Only windows and running sums are separate
+	for(freqtbl_t tbl = copy->begin; tbl <= copy->end; tbl++){
+		tbl->window = NULL;
+		init_freqtbl(tbl, tbl->winwidth);
+	}
+	copy->skips = malloc(sizeof(unsigned int) * count);
+	copy->prev = NULL;
+	(*copy->wave_refs)++;
+	return copy;
+}
+
 void free_spectrum(spectrum_t spec){
+	free(spec->prev);
+	if(spec->lst){
+		free_freqlist(spec->lst);
+		free(spec);
+		return;
+	}
+	
+	int last = --*spec->wave_refs == 0;
 	for(freqtbl_t tbl = spec->begin; tbl <= spec->end; tbl++){
 		if(tbl->window) free(tbl->window);
-		free(tbl->sine);
-		free(tbl->cosine);
+		if(last){
+			free(tbl->sine);
+			free(tbl->cosine);
+		}
 	}
+	if(last) free(spec->wave_refs);
+	free(spec->begin);
+	free(spec->skips);
 	free(spec);
 }
 
 void clear_spectrum(spectrum_t spec){
+	if(spec->prev){
+		for(unsigned int i = 0; i < spec_freqcount(spec); i++) spec->prev[i] = -1;
+	}
+	if(spec->lst){
+		clear_freqlist(spec->lst);
+		return;
+	}
 	for(freqtbl_t tbl = spec->begin; tbl <= spec->end; tbl++){
 		clear_freqtbl(tbl);
 	}
@@ -388,31 +909,245 @@ void clear_spectrum(spectrum_t spec){
 
 // Get number of frequency tables in spectrum
 unsigned int spec_freqcount(spectrum_t spec){
+	if(spec->lst) return freqlist_count(spec->lst);
 	return (unsigned int)(spec->end - spec->begin) + 1;
 }
 
 // Get frequency for `i`th frequency table of spectrum
 double spec_freq(spectrum_t spec, unsigned int i){
+	if(spec->lst) return freqlist_freq(spec->lst, i);
 	return spec->begin[i].frequency;
 }
 
+// Get the number of samples in the longest window of any table in spectrum
+unsigned int spec_samps_perwin(spectrum_t spec){
+	if(spec->lst) return freqlist_samps_perwin(spec->lst);
+	unsigned int width = 0;
+	for(freqtbl_t tbl = spec->begin; tbl <= spec->end; tbl++){
+		if(freqtbl_samps_perwin(tbl) > width) width = freqtbl_samps_perwin(tbl);
+	}
+	return width;
+}
+
 
 
 // Returns amplitudes for `i`th frequency table in spectrum
 double spec_get(spectrum_t spec, unsigned int i){
+	if(spec->lst) return freqlist_get(spec->lst, i);
 	return freqtbl_get(spec->begin + i);
 }
 
+void spec_reset_flux(spectrum_t spec){
+	unsigned int bins = spec_freqcount(spec);
+	if(!spec->prev) spec->prev = malloc(sizeof(double) * bins);
+	for(unsigned int i = 0; i < bins; i++) spec->prev[i] = 0;
+}
+
+void spec_getall(spectrum_t spec, double *ampls, unsigned int count, const spec_feature_t *features, double *values){
+	unsigned int bins = spec_freqcount(spec), i, f;
+	double ampl, freq, weighted = 0, total = 0, peak = 0, peak_freq = -1, flux = 0;
+	int flux_wanted = 0, compared = 0, used = 0;
+	
+	for(f = 0; f < count; f++){
+		values[f] = 0;
+		if(features[f].kind == FEAT_FLUX) flux_wanted = 1;
+	}
+	if(flux_wanted && !spec->prev){
+		spec->prev = malloc(sizeof(double) * bins);
+		for(i = 0; i < bins; i++) spec->prev[i] = -1;
+	}
+	
+	for(i = 0; i < bins; i++){
+		ampl = spec_get(spec, i);
+		if(ampls) ampls[i] = ampl;
+		if(count == 0) continue;
+		
+		if(flux_wanted){
+			if(ampl >= 0 && spec->prev[i] >= 0){
+				if(ampl > spec->prev[i]) flux += ampl - spec->prev[i];
+				compared++;
+			}
+			spec->prev[i] = ampl;
+		}
+		if(ampl < 0) continue;
+		
+		freq = spec_freq(spec, i);
+		used++;
+		weighted += freq * ampl;
+		total += ampl;
+		if(ampl > peak){
+			peak = ampl;
+			peak_freq = freq;
+		}
+		for(f = 0; f < count; f++){
+			if(features[f].kind == FEAT_BAND && freq >= features[f].low && freq < features[f].high) values[f] += ampl * ampl;
+		}
+	}
+	
+	for(f = 0; f < count; f++){
+		switch(features[f].kind){
+			case FEAT_CENTROID: values[f] = total > 0 ? weighted / total : -1;
+			break;
+			case FEAT_PEAK: values[f] = peak_freq;
+			break;
+			case FEAT_FLUX: values[f] = compared ? flux : -1;
+			break;
+			case FEAT_BAND: if(!used) values[f] = -1;
+			break;
+		}
+	}
+}
+
 // Push sample to each frequency table of spectrum
 void spec_push(spectrum_t spec, double sample){
+	if(spec->lst){
+		sample_t samp = sample;
+		freqlist_pushall(spec->lst, 1, &samp);
+		return;
+	}
 	for(freqtbl_t tbl = spec->begin; tbl <= spec->end; tbl++){
 		freqtbl_push(tbl, sample);
 	}
 }
 
 // Push array of samples to each frequency table of spectrum
-void spec_pushall(spectrum_t spec, unsigned int count, double *samples){
+void spec_pushall(spectrum_t spec, unsigned int count, sample_t *samples){
+	freqtbl_t tbl;
+	if(spec->lst){
+		freqlist_pushall(spec->lst, count, samples);
+		return;
+	}
+	if(spec->tile_bins == 0){
+		for(tbl = spec->begin; tbl <= spec->end; tbl++){
+			freqtbl_pushall(tbl, count, samples);
+		}
+		return;
+	}
+	
+	// Make space in every window before adding any samples
+	unsigned int *skip = spec->skips;
+	for(tbl = spec->begin; tbl <= spec->end; tbl++, skip++){
+		*skip = freqtbl_slide(tbl, count);
+	}
+	
+	// Each table adds the same samples in the same order as `freqtbl_pushall`, only interleaved with other tables
+	unsigned int from, to, start;
+	freqtbl_t group, group_end;
+	for(from = 0; from < count; from = to){
+		to = count - from > spec->tile_samps ? from + spec->tile_samps : count;
+		
+		for(group = spec->begin; group <= spec->end; group = group_end){
+			group_end = spec->end - group >= spec->tile_bins ? group + spec->tile_bins : spec->end + 1;
+			
+			for(tbl = group; tbl < group_end; tbl++){
+				start = spec->skips[tbl - spec->begin];
+				if(start < from) start = from;
+				if(start < to) freqtbl_append(tbl, to - start, samples + start);
+			}
+		}
+	}
+}
+
+// Only the last window of samples is read by each table
+unsigned int spec_samps_needed(spectrum_t spec, unsigned int count){
+	unsigned int needed = 0;
+	if(spec->lst) return freqlist_samps_needed(spec->lst, count);
 	for(freqtbl_t tbl = spec->begin; tbl <= spec->end; tbl++){
-		freqtbl_pushall(tbl, count, samples);
+		if(tbl->winwidth <= 0 || tbl->winwidth >= count) return count;
+		if(tbl->winwidth > needed) needed = tbl->winwidth;
+	}
+	return needed;
+}
+
+void spec_set_tile(spectrum_t spec, unsigned int bins, unsigned int samps){
+	if(spec->lst) return;  // Phasors are always updated in blocks of frequencies
+	spec->tile_bins = samps == 0 ? 0 : bins;
+	spec->tile_samps = bins == 0 ? 0 : samps;
+}
+
+unsigned int spec_tile_bins(spectrum_t spec){
+	return spec->tile_bins;
+}
+
+unsigned int spec_tile_samps(spectrum_t spec){
+	return spec->tile_samps;
+}
+
+spec_engine_t spec_engine(spectrum_t spec){
+	return spec->lst ? SPEC_PHASORS : SPEC_TABLES;
+}
+
+
+
+/* Planning
+ * Memory is counted from the sizes each engine would allocate for the spectrum, without allocating it.
+ * Operations are counted per sample and frequency from the inner loops which push samples:
+ * tables multiply and add 4 sums for each sample added or removed, while phasors update 4 sums
+ * and rotate the phasor for every sample, and only skip samples when a line replaces the window.
+ */
+#define PLAN_MAX_ERROR 1.0  // Furthest a frequency may be from its place on the axis, in bins
+#define PLAN_MAX_SMEAR 1.5  // Longest a window may be relative to the window its frequency needs
+
+spec_cost_t spec_estimate(spec_engine_t engine, double sample_freq, double low, double high, int count, double maxdur, unsigned int step){
+	spec_cost_t cost = {0};
+	if(low <= 0 || high <= 0 || low > high || count < 2) return cost;
+	
+	double ratio = pow(high / low, 1 / (double)(count - 1));
+	double f = low, frequency, need, error, smear;
+	unsigned int width, used;
+	int perblk, wavelen, cycs;
+	
+	if(engine == SPEC_PHASORS){
+		width = freqlist_width(sample_freq, low, maxdur);
+		used = step < width ? step : width;
+		cost.bytes = sizeof(struct spectrum_s) + freqlist_size(count, width);
+		cost.flops = count * (20.0 * used + (step >= width ? 60 : 0) + 24);
+		
+		// Highest frequency needs the shortest window
+		need = maxdur * sample_freq;
+		if(need < 5 * sample_freq / high) need = 5 * sample_freq / high;
+		cost.smear = width / need;
+		cost.error = 0;
+	}else{
+		cost.bytes = sizeof(struct spectrum_s) + sizeof(unsigned int) * (1 + count);
+		for(int i = 0; i < count; i++, f *= ratio){
+			// Same sizes as `fill_freqtbl` and `start_freqtbl`
+			perblk = (int)(sample_freq / f);
+			if(perblk < 1) perblk = 1;
+			frequency = sample_freq / perblk;
+			wavelen = perblk * ((WAVE_MIN_RUN + perblk - 1) / perblk);
+			cycs = (unsigned int)(maxdur * frequency * perblk) / perblk;
+			if(cycs < 5) cycs = 5;
+			width = cycs * perblk;
+			cost.bytes += sizeof(struct freqtbl_s) + sizeof(sample_t) * (2 * wavelen + width);
+			
+			// Samples added, then those removed or the rest of the window refilled
+			used = step < width ? step : width;
+			cost.flops += 8.0 * used + 12;
+			if(step < width) cost.flops += 8.0 * (2 * step >= width ? width - step : step);
+			
+			error = fabs(log(frequency / f) / log(ratio));
+			if(error > cost.error) cost.error = error;
+			need = maxdur * sample_freq;
+			if(need < 5 * sample_freq / f) need = 5 * sample_freq / f;
+			smear = width / need;
+			if(smear > cost.smear) cost.smear = smear;
+		}
+	}
+	
+	cost.accurate = cost.error <= PLAN_MAX_ERROR && cost.smear <= PLAN_MAX_SMEAR;
+	return cost;
+}
+
+int spec_plan(double sample_freq, double low, double high, int count, double maxdur, unsigned int step, size_t budget, spec_cost_t costs[SPEC_ENGINES]){
+	int best = -1;
+	for(int e = 0; e < SPEC_ENGINES; e++){
+		costs[e] = spec_estimate(e, sample_freq, low, high, count, maxdur, step);
+		if(budget > 0 && costs[e].bytes > budget) continue;
+		if(best < 0
+		|| costs[e].accurate > costs[best].accurate
+		|| (costs[e].accurate == costs[best].accurate && costs[e].flops < costs[best].flops)
+		) best = e;
 	}
+	return best;
 }
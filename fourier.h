@@ -1,6 +1,16 @@
 #ifndef _FOURIER_H
 #define _FOURIER_H
 
+#include <stddef.h>
+
+// Type used to store samples, windows and wave data
+// Running sums are always accumulated in double precision
+#ifdef SPECTRO_FLOAT32
+typedef float sample_t;
+#else
+typedef double sample_t;
+#endif
+
 struct freqtbl_s;
 typedef struct freqtbl_s *freqtbl_t;
 
@@ -24,21 +34,82 @@ double freqtbl_get(freqtbl_t tbl);
 // Moves window forward by one sample
 void freqtbl_push(freqtbl_t tbl, double sample);
 // Moves window forward by multiple samples
-void freqtbl_pushall(freqtbl_t tbl, unsigned int count, double *samples);
+void freqtbl_pushall(freqtbl_t tbl, unsigned int count, sample_t *samples);
 
 // Get the number of samples per block
 unsigned int freqtbl_samps_perblk(freqtbl_t tbl);
+// Get the number of samples per window or zero if the window is unbounded
+unsigned int freqtbl_samps_perwin(freqtbl_t tbl);
 // Get the frequency for this table
 double freqtbl_freq(freqtbl_t tbl);
 
 
 
+struct freqlist_s;
+typedef struct freqlist_s *freqlist_t;
+
+// Track `count` arbitrary frequencies together using a single shared window of samples
+// Window lasts `maxdur` or long enough to contain 5 cycles of the lowest frequency
+// Memory used per frequency is constant regardless of the frequency or window
+freqlist_t gen_freqlist(double sample_freq, unsigned int count, const double *freqs, double maxdur);
+void free_freqlist(freqlist_t lst);
+// Reset running sums and empty window
+void clear_freqlist(freqlist_t lst);
+
+// Get number of frequencies in list
+unsigned int freqlist_count(freqlist_t lst);
+// Get `i`th frequency of list
+double freqlist_freq(freqlist_t lst, unsigned int i);
+// Get the number of samples in the shared window
+unsigned int freqlist_samps_perwin(freqlist_t lst);
+// Get number of bytes allocated for list, zero when there is no list
+size_t freqlist_bytes(freqlist_t lst);
+
+// Returns current amplitude for `i`th frequency or a negative number if no amplitude is available yet
+double freqlist_get(freqlist_t lst, unsigned int i);
+// Moves window forward by multiple samples updating every frequency in one pass
+void freqlist_pushall(freqlist_t lst, unsigned int count, sample_t *samples);
+// Get how many of the last samples of the next `count` samples pushed will be read
+// Leading samples before them are skipped and need not be filled in
+unsigned int freqlist_samps_needed(freqlist_t lst, unsigned int count);
+
+
+
 struct spectrum_s;
 typedef struct spectrum_s *spectrum_t;
 
+// Ways of computing the amplitudes of a spectrum
+typedef enum {
+	SPEC_TABLES = 0,  // Wave data and a window of whole cycles for each table, frequencies are rounded to whole samples per cycle
+	SPEC_PHASORS,  // Exact frequencies from a list sharing one window, as long as the lowest frequency needs
+	SPEC_ENGINES
+} spec_engine_t;
+
+// Estimated cost of a spectrum computed with one engine
+typedef struct {
+	size_t bytes;  // Memory allocated
+	double flops;  // Floating point operations per line
+	double error;  // Furthest distance of a frequency from its place on the axis, in bins
+	double smear;  // Longest window relative to the window its frequency needs
+	int accurate;  // Whether error and smear are within the limits of planning
+} spec_cost_t;
+
 // Generate spectrum over frequency range [low, high] with `count` number of frequency tables
 // Initializes frequency tables with windows of duration no longer than `maxdur`
 spectrum_t gen_spectrum(double sample_freq, double low, double high, int count, double maxdur);
+// Generate spectrum over the same frequencies as `gen_spectrum` computed by `engine`
+spectrum_t gen_spectrum_with(spec_engine_t engine, double sample_freq, double low, double high, int count, double maxdur);
+// Estimate cost of generating spectrum with `engine` and pushing lines of `step` samples to it
+spec_cost_t spec_estimate(spec_engine_t engine, double sample_freq, double low, double high, int count, double maxdur, unsigned int step);
+// Choose the accurate engine with the fewest operations per line using at most `budget` bytes, zero for no limit
+// Falls back to the engine with the fewest operations when none within budget is accurate
+// Fills `costs` with the estimate for every engine and returns -1 when none fits within budget
+int spec_plan(double sample_freq, double low, double high, int count, double maxdur, unsigned int step, size_t budget, spec_cost_t costs[SPEC_ENGINES]);
+// Get engine computing spectrum
+spec_engine_t spec_engine(spectrum_t spec);
+// Generate empty spectrum with the same tables and windows as `spec`, sharing its read-only wave data
+// Spectra sharing wave data must be generated and freed from one thread, it is freed with the last of them
+spectrum_t share_spectrum(spectrum_t spec);
 // Deallocate spectrum and associated frequency tables
 void free_spectrum(spectrum_t spec);
 // Clear the running sums of every table
@@ -48,12 +119,43 @@ void clear_spectrum(spectrum_t spec);
 unsigned int spec_freqcount(spectrum_t spec);
 // Get frequency for `i`th frequency table of spectrum
 double spec_freq(spectrum_t spec, unsigned int i);
+// Get the number of samples in the longest window of any table in spectrum
+unsigned int spec_samps_perwin(spectrum_t spec);
 
 // Returns amplitudes for `i`th frequency table in spectrum
 double spec_get(spectrum_t spec, unsigned int i);
+// Kinds of features summarizing a line of a spectrum
+typedef enum {
+	FEAT_CENTROID,  // Mean of frequencies weighted by their amplitudes
+	FEAT_PEAK,  // Frequency with the largest amplitude
+	FEAT_FLUX,  // Sum of the increases in amplitude since the previous line
+	FEAT_BAND  // Sum of squared amplitudes of frequencies in [low, high)
+} feat_kind_t;
+
+typedef struct {
+	feat_kind_t kind;
+	double low, high;  // Bounds of band
+} spec_feature_t;
+
+// Collect amplitudes of every table into `ampls` unless it is NULL, computing `count` `features` into `values` in the same pass
+// Amplitudes which are not available yet are left out, features without any are negative
+// Flux compares to the amplitudes of the previous call, so features must be requested for every line
+void spec_getall(spectrum_t spec, double *ampls, unsigned int count, const spec_feature_t *features, double *values);
+// Make the next flux measure the rise from silence, for lines left blank without calling `spec_getall`
+void spec_reset_flux(spectrum_t spec);
 // Push sample to each frequency table of spectrum
 void spec_push(spectrum_t spec, double sample);
 // Push array of samples to each frequency table of spectrum
-void spec_pushall(spectrum_t spec, unsigned int count, double *samples);
+// Updates groups of `tile_bins` tables over runs of `tile_samps` samples at a time
+void spec_pushall(spectrum_t spec, unsigned int count, sample_t *samples);
+// Get how many of the last samples of the next `count` samples pushed will be read by any table
+// Leading samples before them are skipped and need not be filled in
+unsigned int spec_samps_needed(spectrum_t spec, unsigned int count);
+
+// Set number of tables and samples updated together by `spec_pushall`
+// Tile size is chosen from the cache sizes by `gen_spectrum`, zero disables tiling
+void spec_set_tile(spectrum_t spec, unsigned int bins, unsigned int samps);
+unsigned int spec_tile_bins(spectrum_t spec);
+unsigned int spec_tile_samps(spectrum_t spec);
 
 #endif
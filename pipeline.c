@@ -0,0 +1,93 @@
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "pipeline.h"
+
+
+
+// Number of times to check a counter again before sleeping on it
+#define PIPELINE_SPINS 64
+
+struct pipeline_s {
+	unsigned int stages, depth;
+	
+	// Number of slots released by each stage, only written by the thread running that stage
+	// Counters wrap around so they are only ever compared by their difference
+	_Atomic unsigned int *done;
+	_Atomic unsigned int *waiting;  // Number of threads sleeping until each stage releases a slot
+	
+	unsigned long *stalls;
+};
+
+
+pipeline_t make_pipeline(unsigned int stages, unsigned int depth){
+	if(stages == 0 || depth == 0) return NULL;
+	
+	pipeline_t pl = malloc(sizeof(struct pipeline_s));
+	pl->stages = stages;
+	pl->depth = depth;
+	pl->done = malloc(sizeof(_Atomic unsigned int) * stages);
+	pl->waiting = malloc(sizeof(_Atomic unsigned int) * stages);
+	pl->stalls = malloc(sizeof(unsigned long) * stages);
+	for(unsigned int s = 0; s < stages; s++){
+		atomic_init(pl->done + s, 0);
+		atomic_init(pl->waiting + s, 0);
+		pl->stalls[s] = 0;
+	}
+	return pl;
+}
+
+void free_pipeline(pipeline_t pl){
+	if(!pl) return;
+	free((void*)pl->done);
+	free((void*)pl->waiting);
+	free(pl->stalls);
+	free(pl);
+}
+
+
+
+// Whether `stage` may take slot `next` when the stage it depends on has released `prior` slots
+static int slot_ready(pipeline_t pl, unsigned int stage, unsigned int next, unsigned int prior){
+	if(stage == 0) return next - prior < pl->depth;  // A slot must have been freed by the last stage
+	return prior - next > 0;
+}
+
+unsigned int pipeline_acquire(pipeline_t pl, unsigned int stage){
+	unsigned int prev = stage == 0 ? pl->stages - 1 : stage - 1;
+	unsigned int next = atomic_load_explicit(pl->done + stage, memory_order_relaxed);
+	unsigned int prior;
+	
+	// Check without any locks or system calls first
+	for(int i = 0; i < PIPELINE_SPINS; i++){
+		prior = atomic_load_explicit(pl->done + prev, memory_order_acquire);
+		if(slot_ready(pl, stage, next, prior)) return next % pl->depth;
+	}
+	
+	// Sleep until the previous stage releases a slot
+	// Announcing the wait before checking again means a release cannot be missed
+	pl->stalls[stage]++;
+	atomic_fetch_add(pl->waiting + prev, 1);
+	while(!slot_ready(pl, stage, next, prior = atomic_load(pl->done + prev))){
+		syscall(SYS_futex, (unsigned int*)(pl->done + prev), FUTEX_WAIT_PRIVATE, prior, NULL, NULL, 0);
+	}
+	atomic_fetch_sub(pl->waiting + prev, 1);
+	return next % pl->depth;
+}
+
+void pipeline_release(pipeline_t pl, unsigned int stage){
+	atomic_fetch_add(pl->done + stage, 1);
+	if(atomic_load(pl->waiting + stage) > 0){
+		syscall(SYS_futex, (unsigned int*)(pl->done + stage), FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+	}
+}
+
+
+
+unsigned long pipeline_stalls(pipeline_t pl, unsigned int stage){
+	return pl->stalls[stage];
+}
@@ -0,0 +1,20 @@
+#ifndef _PIPELINE_H
+#define _PIPELINE_H
+
+struct pipeline_s;
+typedef struct pipeline_s *pipeline_t;
+
+// Ring of `depth` slots which pass in order through `stages` stages, each run by a single thread
+// A stage waits for the stage before it and the first stage waits for the last one to free a slot
+pipeline_t make_pipeline(unsigned int stages, unsigned int depth);
+void free_pipeline(pipeline_t pl);
+
+// Wait until the next slot is ready for `stage` and return its index in [0, depth)
+unsigned int pipeline_acquire(pipeline_t pl, unsigned int stage);
+// Pass the slot last acquired by `stage` on to the next stage
+void pipeline_release(pipeline_t pl, unsigned int stage);
+
+// Get number of times `stage` found no slot ready and had to wait
+unsigned long pipeline_stalls(pipeline_t pl, unsigned int stage);
+
+#endif
@@ -0,0 +1,200 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "publish.h"
+
+
+
+struct publisher_s {
+	char *name;
+	dev_t dev;  // Identity of the object, in case `name` has since been replaced by another publisher
+	ino_t ino;
+	publish_header_t *head;
+	size_t size;
+	uint64_t count;  // Number of frames published
+};
+
+struct subscriber_s {
+	publish_header_t *head;
+	size_t size;
+	uint64_t next;  // Number of the next frame to read
+	unsigned long dropped;
+};
+
+
+
+// Get slot holding frame `n`
+static publish_frame_t *frame_at(publish_header_t *head, uint64_t n){
+	uint8_t *ring = (uint8_t*)(head + 1) + sizeof(double) * head->bins;
+	return (publish_frame_t*)(ring + (n % head->slots) * head->frame_size);
+}
+
+publisher_t make_publisher(const char *name, unsigned int bins, unsigned int tracked, const double *axis, unsigned int slots, int replace){
+	if(slots == 0) return NULL;
+	
+	unsigned int frame_size = sizeof(publish_frame_t) + sizeof(double) * bins;
+	size_t size = sizeof(publish_header_t) + sizeof(double) * bins + (size_t)frame_size * slots;
+	// Readers of a replaced object keep their mapping of it and see a fresh object once they reopen `name`
+	if(replace) shm_unlink(name);
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+	if(fd < 0) return NULL;
+	struct stat info;
+	if(ftruncate(fd, size) || fstat(fd, &info)){
+		close(fd);
+		shm_unlink(name);
+		return NULL;
+	}
+	publish_header_t *head = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(head == MAP_FAILED){
+		shm_unlink(name);
+		return NULL;
+	}
+	
+	// Object is zeroed by `ftruncate` so every slot starts out unwritten
+	head->bins = bins;
+	head->tracked = tracked;
+	head->slots = slots;
+	head->frame_size = frame_size;
+	memcpy(head + 1, axis, sizeof(double) * bins);
+	atomic_store(&head->published, 0);
+	atomic_store(&head->closed, 0);
+	
+	// Readers check the magic number last
+	atomic_thread_fence(memory_order_release);
+	head->magic = PUBLISH_MAGIC;
+	
+	publisher_t pub = malloc(sizeof(struct publisher_s));
+	pub->name = strdup(name);
+	pub->dev = info.st_dev;
+	pub->ino = info.st_ino;
+	pub->head = head;
+	pub->size = size;
+	pub->count = 0;
+	return pub;
+}
+
+void free_publisher(publisher_t pub){
+	if(!pub) return;
+	atomic_store(&pub->head->closed, 1);
+	munmap(pub->head, pub->size);
+	
+	// Only remove the name while it still refers to this object
+	struct stat info;
+	int fd = shm_open(pub->name, O_RDONLY, 0);
+	if(fd >= 0){
+		if(fstat(fd, &info) == 0 && info.st_dev == pub->dev && info.st_ino == pub->ino) shm_unlink(pub->name);
+		close(fd);
+	}
+	free(pub->name);
+	free(pub);
+}
+
+void publish_frame(publisher_t pub, double time, const double *ampls){
+	publish_frame_t *frame = frame_at(pub->head, pub->count);
+	
+	// Readers which see an odd or changed sequence number discard what they read
+	atomic_store_explicit(&frame->seq, 2 * pub->count + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	frame->time = time;
+	frame->wall = now.tv_sec + now.tv_nsec / 1e9;
+	memcpy(frame->ampls, ampls, sizeof(double) * pub->head->bins);
+	
+	atomic_store_explicit(&frame->seq, 2 * pub->count + 2, memory_order_release);
+	atomic_store_explicit(&pub->head->published, ++pub->count, memory_order_release);
+}
+
+
+
+subscriber_t open_subscriber(const char *name){
+	int fd = shm_open(name, O_RDONLY, 0);
+	if(fd < 0) return NULL;
+	struct stat info;
+	if(fstat(fd, &info) || info.st_size < (off_t)sizeof(publish_header_t)){
+		close(fd);
+		return NULL;
+	}
+	publish_header_t *head = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(head == MAP_FAILED) return NULL;
+	
+	if(head->magic != PUBLISH_MAGIC || info.st_size < (off_t)(sizeof(publish_header_t) + sizeof(double) * head->bins + (size_t)head->frame_size * head->slots)){
+		munmap(head, info.st_size);
+		return NULL;
+	}
+	atomic_thread_fence(memory_order_acquire);
+	
+	subscriber_t sub = malloc(sizeof(struct subscriber_s));
+	sub->head = head;
+	sub->size = info.st_size;
+	uint64_t published = atomic_load(&head->published);
+	sub->next = published > head->slots ? published - head->slots : 0;
+	sub->dropped = 0;
+	return sub;
+}
+
+void close_subscriber(subscriber_t sub){
+	if(!sub) return;
+	munmap(sub->head, sub->size);
+	free(sub);
+}
+
+
+
+unsigned int subscriber_bins(subscriber_t sub){
+	return sub->head->bins;
+}
+
+unsigned int subscriber_tracked(subscriber_t sub){
+	return sub->head->tracked;
+}
+
+double subscriber_freq(subscriber_t sub, unsigned int i){
+	return ((const double*)(sub->head + 1))[i];
+}
+
+
+
+const publish_frame_t *subscriber_next(subscriber_t sub){
+	uint64_t published, seq;
+	publish_frame_t *frame;
+	for(;;){
+		published = atomic_load_explicit(&sub->head->published, memory_order_acquire);
+		if(sub->next >= published) return NULL;
+		
+		// Skip frames which have already been overwritten, leaving one slot of margin for the one being written
+		if(published - sub->next >= sub->head->slots){
+			sub->dropped += published - sub->next - (sub->head->slots - 1);
+			sub->next = published - (sub->head->slots - 1);
+		}
+		
+		// Frame may still have been overwritten since `published` was read
+		frame = frame_at(sub->head, sub->next++);
+		seq = atomic_load_explicit(&frame->seq, memory_order_acquire);
+		if(seq == 2 * sub->next) return frame;
+		sub->dropped++;
+	}
+}
+
+int subscriber_lost(subscriber_t sub, const publish_frame_t *frame){
+	atomic_thread_fence(memory_order_acquire);
+	if(atomic_load_explicit(&((publish_frame_t*)frame)->seq, memory_order_relaxed) == 2 * sub->next) return 0;
+	sub->dropped++;
+	return -1;
+}
+
+int subscriber_done(subscriber_t sub){
+	return atomic_load(&sub->head->closed) && sub->next >= atomic_load(&sub->head->published);
+}
+
+unsigned long subscriber_dropped(subscriber_t sub){
+	return sub->dropped;
+}
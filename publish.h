@@ -0,0 +1,70 @@
+#ifndef _PUBLISH_H
+#define _PUBLISH_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+// Shared memory object starts with a header, followed by the frequency of each bin and then the ring of frames
+// Frame `n` is kept in slot `n % slots` until it is overwritten by frame `n + slots`
+#define PUBLISH_MAGIC 0x314f525443455053ULL  // "SPECTRO1" stored little endian
+
+typedef struct {
+	uint64_t magic;
+	uint32_t bins;  // Number of values in each frame
+	uint32_t tracked;  // Number of values at the start of each frame which are tracked frequencies, the rest are the spectrum
+	uint32_t slots;  // Number of frames in ring
+	uint32_t frame_size;  // Number of bytes between frames
+	_Atomic uint64_t published;  // Number of frames written
+	atomic_int closed;  // Whether publisher has stopped
+} publish_header_t;
+
+typedef struct {
+	// Twice the frame number plus one while being written, plus two once complete
+	_Atomic uint64_t seq;
+	double time;  // Position of frame in audio in seconds
+	double wall;  // Real time at which frame was published in seconds since the epoch
+	double ampls[];  // Amplitude of each bin, negative for tracked frequencies whose window has not filled yet
+} publish_frame_t;
+
+
+struct publisher_s;
+typedef struct publisher_s *publisher_t;
+
+// Create shared memory object `name` (such as "/spectro") holding a ring of `slots` frames of `bins` values
+// The first `tracked` bins are tracked frequencies, `axis` gives the frequency of each bin
+// Fails with `errno` set to EEXIST if `name` already exists, unless `replace` is set to unlink it first
+// An existing object is never truncated since readers may still have it mapped
+publisher_t make_publisher(const char *name, unsigned int bins, unsigned int tracked, const double *axis, unsigned int slots, int replace);
+// Mark publisher as closed and remove shared memory object unless it was replaced, readers which have mapped it can still read it
+void free_publisher(publisher_t pub);
+
+// Write next frame into ring, overwriting the oldest one
+void publish_frame(publisher_t pub, double time, const double *ampls);
+
+
+struct subscriber_s;
+typedef struct subscriber_s *subscriber_t;
+
+// Map shared memory object `name` written by a publisher, returns NULL if it does not exist or is not a publisher
+// Reading starts from the oldest frame still in the ring
+subscriber_t open_subscriber(const char *name);
+void close_subscriber(subscriber_t sub);
+
+unsigned int subscriber_bins(subscriber_t sub);
+unsigned int subscriber_tracked(subscriber_t sub);
+// Get frequency of `i`th bin
+double subscriber_freq(subscriber_t sub, unsigned int i);
+
+// Get next frame in place without copying it or making any system calls
+// Returns NULL when no new frame has been published yet
+// Frames which were overwritten before being reached are skipped and counted as dropped
+const publish_frame_t *subscriber_next(subscriber_t sub);
+// Check that frame returned by `subscriber_next` was not overwritten while it was being read
+// Returns non-zero if values read from it may be corrupt, in which case it is counted as dropped
+int subscriber_lost(subscriber_t sub, const publish_frame_t *frame);
+// Whether publisher has stopped and every frame has been read
+int subscriber_done(subscriber_t sub);
+// Get number of frames skipped because they were overwritten
+unsigned long subscriber_dropped(subscriber_t sub);
+
+#endif
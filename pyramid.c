@@ -0,0 +1,246 @@
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "pyramid.h"
+
+#define PYRAMID_MAGIC "SPYR"
+#define PYRAMID_VERSION 3
+
+
+struct level_s {
+	unsigned int len, cap;  // Number of frames in level and number allocated
+	// Arrays of `len * bins` values storing the maximum and mean of each aggregated frame
+	// NOTE: Both point to the same array on the finest level
+	float *max, *mean;
+};
+
+struct pyramid_s {
+	unsigned int bins;
+	double rate;  // Frames per second at finest level
+	pyr_source_t source;
+	double *axis;  // Frequency of each bin
+	
+	unsigned int levelc;  // Number of levels in use
+	struct level_s levels[32];  // Level `k` aggregates 2^k frames
+};
+
+
+pyramid_t make_pyramid(unsigned int bins, const double *axis, double frame_rate, const pyr_source_t *source){
+	if(bins == 0 || frame_rate <= 0) return NULL;
+	
+	pyramid_t pyr = malloc(sizeof(struct pyramid_s));
+	pyr->bins = bins;
+	pyr->rate = frame_rate;
+	pyr->source = *source;
+	pyr->axis = malloc(sizeof(double) * bins);
+	memcpy(pyr->axis, axis, sizeof(double) * bins);
+	
+	pyr->levelc = 1;
+	memset(pyr->levels, 0, sizeof(pyr->levels));
+	return pyr;
+}
+
+void free_pyramid(pyramid_t pyr){
+	if(!pyr) return;
+	
+	free(pyr->levels[0].max);
+	for(unsigned int k = 1; k < pyr->levelc; k++){
+		free(pyr->levels[k].max);
+		free(pyr->levels[k].mean);
+	}
+	free(pyr->axis);
+	free(pyr);
+}
+
+
+
+// Make space for `len` frames in level `k`
+static void reserve_level(pyramid_t pyr, unsigned int k, unsigned int len){
+	struct level_s *lvl = pyr->levels + k;
+	if(len <= lvl->cap) return;
+	
+	if(lvl->cap == 0) lvl->cap = 16;
+	while(lvl->cap < len) lvl->cap *= 2;
+	
+	lvl->max = realloc(lvl->max, sizeof(float) * lvl->cap * pyr->bins);
+	if(k == 0) lvl->mean = lvl->max;
+	else lvl->mean = realloc(lvl->mean, sizeof(float) * lvl->cap * pyr->bins);
+}
+
+void pyramid_push(pyramid_t pyr, const double *frame){
+	struct level_s *lvl = pyr->levels;
+	reserve_level(pyr, 0, lvl->len + 1);
+	
+	float *dst = lvl->max + lvl->len * pyr->bins;
+	for(unsigned int i = 0; i < pyr->bins; i++) dst[i] = (float)frame[i];
+	lvl->len++;
+	
+	// Whenever a level completes a pair of frames aggregate them into the next level
+	for(unsigned int k = 0; k + 1 < 32 && pyr->levels[k].len % 2 == 0; k++){
+		lvl = pyr->levels + k;
+		if(k + 1 >= pyr->levelc) pyr->levelc = k + 2;
+		
+		struct level_s *up = lvl + 1;
+		reserve_level(pyr, k + 1, up->len + 1);
+		
+		float *amax = lvl->max + (lvl->len - 2) * pyr->bins, *bmax = amax + pyr->bins;
+		float *amean = lvl->mean + (lvl->len - 2) * pyr->bins, *bmean = amean + pyr->bins;
+		float *umax = up->max + up->len * pyr->bins, *umean = up->mean + up->len * pyr->bins;
+		for(unsigned int i = 0; i < pyr->bins; i++){
+			umax[i] = amax[i] > bmax[i] ? amax[i] : bmax[i];
+			umean[i] = (amean[i] + bmean[i]) / 2;
+		}
+		up->len++;
+	}
+}
+
+
+
+unsigned int pyramid_bins(pyramid_t pyr){
+	return pyr->bins;
+}
+
+double pyramid_freq(pyramid_t pyr, unsigned int i){
+	return pyr->axis[i];
+}
+
+double pyramid_rate(pyramid_t pyr){
+	return pyr->rate;
+}
+
+const pyr_source_t *pyramid_source(pyramid_t pyr){
+	return &(pyr->source);
+}
+
+unsigned int pyramid_length(pyramid_t pyr){
+	return pyr->levels[0].len;
+}
+
+unsigned int pyramid_levels(pyramid_t pyr){
+	return pyr->levelc;
+}
+
+
+
+int pyramid_pool(pyramid_t pyr, unsigned int from, unsigned int to, pool_t mode, double *out){
+	unsigned int i, k, total = 0;
+	float *src;
+	
+	for(i = 0; i < pyr->bins; i++) out[i] = mode == POOL_MAX ? -INFINITY : 0;
+	
+	// Cover interval with the largest aligned blocks available
+	while(from < to){
+		for(k = 0; k + 1 < pyr->levelc; k++){
+			unsigned int width = 2u << k;
+			if(from % width != 0 || from + width > to) break;
+			if((from >> (k + 1)) >= pyr->levels[k + 1].len) break;
+		}
+		if((from >> k) >= pyr->levels[k].len) break;  // Past the end of the pyramid
+		
+		if(mode == POOL_MAX){
+			src = pyr->levels[k].max + (from >> k) * pyr->bins;
+			for(i = 0; i < pyr->bins; i++) if(src[i] > out[i]) out[i] = src[i];
+		}else{
+			src = pyr->levels[k].mean + (from >> k) * pyr->bins;
+			for(i = 0; i < pyr->bins; i++) out[i] += src[i] * (1u << k);
+		}
+		
+		from += 1u << k;
+		total += 1u << k;
+	}
+	
+	if(total == 0) return 1;
+	if(mode == POOL_MEAN){
+		for(i = 0; i < pyr->bins; i++) out[i] /= total;
+	}
+	return 0;
+}
+
+
+
+/* File Format (native byte order)
+ * "SPYR", uint32 version, uint32 bins, uint32 length of finest level, uint32 channel, double frame rate, double gate level
+ * uint64 size of audio file, int64 seconds and int64 nanoseconds of its modification time
+ * double[bins] frequency axis
+ * float[length * bins] finest level
+ * For each coarser level: float[len * bins] maximums then float[len * bins] means
+ */
+int write_pyramid(pyramid_t pyr, FILE *fl){
+	uint32_t head[4] = {PYRAMID_VERSION, pyr->bins, pyr->levels[0].len, pyr->source.channel};
+	int64_t mtime[2] = {pyr->source.mtime_sec, pyr->source.mtime_nsec};
+	
+	if(fwrite(PYRAMID_MAGIC, 1, 4, fl) != 4) return 1;
+	if(fwrite(head, sizeof(uint32_t), 4, fl) != 4) return 1;
+	if(fwrite(&(pyr->rate), sizeof(double), 1, fl) != 1) return 1;
+	if(fwrite(&(pyr->source.gate), sizeof(double), 1, fl) != 1) return 1;
+	if(fwrite(&(pyr->source.size), sizeof(uint64_t), 1, fl) != 1) return 1;
+	if(fwrite(mtime, sizeof(int64_t), 2, fl) != 2) return 1;
+	if(fwrite(pyr->axis, sizeof(double), pyr->bins, fl) != pyr->bins) return 1;
+	
+	struct level_s *lvl;
+	for(unsigned int k = 0; k < pyr->levelc; k++){
+		lvl = pyr->levels + k;
+		if(fwrite(lvl->max, sizeof(float) * pyr->bins, lvl->len, fl) != lvl->len) return 1;
+		if(k > 0 && fwrite(lvl->mean, sizeof(float) * pyr->bins, lvl->len, fl) != lvl->len) return 1;
+	}
+	return 0;
+}
+
+pyramid_t read_pyramid(FILE *fl, pyr_err *err){
+	char magic[4];
+	uint32_t head[4];
+	double rate;
+	int64_t mtime[2];
+	pyr_source_t source;
+	
+	if(fread(magic, 1, 4, fl) != 4 || strncmp(magic, PYRAMID_MAGIC, 4) != 0
+	|| fread(head, sizeof(uint32_t), 4, fl) != 4 || head[0] != PYRAMID_VERSION || head[1] == 0
+	){
+		*err = PYR_NOT_PYRAMID;
+		return NULL;
+	}
+	if(fread(&rate, sizeof(double), 1, fl) != 1 || fread(&(source.gate), sizeof(double), 1, fl) != 1
+	|| fread(&(source.size), sizeof(uint64_t), 1, fl) != 1 || fread(mtime, sizeof(int64_t), 2, fl) != 2
+	){
+		*err = PYR_TRUNCATED;
+		return NULL;
+	}
+	
+	double axis[head[1]];
+	if(fread(axis, sizeof(double), head[1], fl) != head[1]){
+		*err = PYR_TRUNCATED;
+		return NULL;
+	}
+	
+	source.channel = head[3];
+	source.mtime_sec = mtime[0];
+	source.mtime_nsec = mtime[1];
+	pyramid_t pyr = make_pyramid(head[1], axis, rate, &source);
+	if(!pyr){
+		*err = PYR_NOT_PYRAMID;
+		return NULL;
+	}
+	
+	// Length of each coarser level is half of the previous one
+	struct level_s *lvl;
+	unsigned int len = head[2];
+	for(unsigned int k = 0; k < 32 && (k == 0 || len > 0); k++, len /= 2){
+		lvl = pyr->levels + k;
+		reserve_level(pyr, k, len);
+		lvl->len = len;
+		if(k + 1 > pyr->levelc) pyr->levelc = k + 1;
+		
+		if(fread(lvl->max, sizeof(float) * pyr->bins, len, fl) != len
+		|| (k > 0 && fread(lvl->mean, sizeof(float) * pyr->bins, len, fl) != len)
+		){
+			*err = PYR_TRUNCATED;
+			free_pyramid(pyr);
+			return NULL;
+		}
+	}
+	
+	*err = PYR_OK;
+	return pyr;
+}
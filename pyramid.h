@@ -0,0 +1,62 @@
+#ifndef _PYRAMID_H
+#define _PYRAMID_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+struct pyramid_s;
+typedef struct pyramid_s *pyramid_t;
+
+typedef enum{
+	PYR_OK = 0,
+	PYR_NOT_PYRAMID,
+	PYR_TRUNCATED
+} pyr_err;
+
+// How the frames of a pyramid were analyzed and from which audio file, so that a stale pyramid is not reused
+typedef struct {
+	unsigned int channel;  // Channel of audio analyzed
+	double gate;  // RMS level below which frames are blank, negative if ungated
+	uint64_t size;  // Size of audio file in bytes
+	int64_t mtime_sec, mtime_nsec;  // Modification time of audio file
+} pyr_source_t;
+
+typedef enum{
+	POOL_MAX = 0,
+	POOL_MEAN
+} pool_t;
+
+// Allocate empty pyramid of frames, each containing `bins` values, produced at `frame_rate` frames per second
+// `axis` gives the frequency of each bin and is copied
+// `source` records how and from what the frames were analyzed and is copied
+pyramid_t make_pyramid(unsigned int bins, const double *axis, double frame_rate, const pyr_source_t *source);
+// Deallocate pyramid and all of its levels
+void free_pyramid(pyramid_t pyr);
+
+// Read pyramid previously written by `write_pyramid`
+pyramid_t read_pyramid(FILE *fl, pyr_err *err);
+// Write every level of pyramid to file stream, returns non-zero on failure
+int write_pyramid(pyramid_t pyr, FILE *fl);
+
+// Append frame of `bins` values to finest level and aggregate into coarser levels
+void pyramid_push(pyramid_t pyr, const double *frame);
+
+// Get number of values in each frame
+unsigned int pyramid_bins(pyramid_t pyr);
+// Get frequency of `i`th bin
+double pyramid_freq(pyramid_t pyr, unsigned int i);
+// Get number of frames per second at finest level
+double pyramid_rate(pyramid_t pyr);
+// Get how and from what the frames were analyzed
+const pyr_source_t *pyramid_source(pyramid_t pyr);
+// Get number of frames at finest level
+unsigned int pyramid_length(pyramid_t pyr);
+// Get number of levels, level `k` aggregates 2^k frames of the finest level
+unsigned int pyramid_levels(pyramid_t pyr);
+
+// Pool frames [from, to) of the finest level into `out` using the coarsest levels that fit
+// Takes time proportional to the logarithm of the number of frames pooled
+// Returns non-zero if no frames are in the interval
+int pyramid_pool(pyramid_t pyr, unsigned int from, unsigned int to, pool_t mode, double *out);
+
+#endif
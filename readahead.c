@@ -0,0 +1,147 @@
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "readahead.h"
+#include "pipeline.h"
+
+
+
+enum {STAGE_READ, STAGE_USE, STAGE_COUNT};
+
+typedef struct {
+	uint8_t *data;
+	long offset;
+	unsigned int len;
+	unsigned int seek;  // Request which block was read for
+	int last;  // Helper thread has stopped
+} block_t;
+
+struct readahead_s {
+	int fd;
+	unsigned int block_size, depth;
+	block_t *blocks;
+	uint8_t *data;
+	pipeline_t pl;
+	pthread_t reader;
+	
+	// Requests to read from another offset, numbered so that blocks read before them can be discarded
+	_Atomic unsigned int seek;
+	_Atomic long seek_offset;
+	atomic_int stop;
+	
+	// Only used by reader of blocks
+	int held;  // Whether a block has been acquired and not yet released
+	long next;  // Offset of block which follows the held one
+	unsigned long requested, stalls;
+};
+
+
+
+// Read blocks in order until stopped, starting again whenever another offset is requested
+static void *read_blocks(void *arg){
+	readahead_t ra = arg;
+	unsigned int seek = atomic_load(&ra->seek), latest;
+	long offset = atomic_load(&ra->seek_offset);
+	ssize_t len;
+	block_t *blk;
+	for(;;){
+		blk = ra->blocks + pipeline_acquire(ra->pl, STAGE_READ);
+		if(atomic_load(&ra->stop)){
+			blk->last = 1;
+			pipeline_release(ra->pl, STAGE_READ);
+			return NULL;
+		}
+		
+		// Offset is written before the request number so it is current when the number changes
+		latest = atomic_load_explicit(&ra->seek, memory_order_acquire);
+		if(latest != seek){
+			seek = latest;
+			offset = atomic_load(&ra->seek_offset);
+		}
+		
+		len = pread(ra->fd, blk->data, ra->block_size, offset);
+		blk->offset = offset;
+		blk->len = len > 0 ? len : 0;
+		blk->seek = seek;
+		blk->last = 0;
+		offset += blk->len;
+		pipeline_release(ra->pl, STAGE_READ);
+	}
+}
+
+readahead_t make_readahead(int fd, unsigned int block_size, unsigned int blocks, long offset){
+	if(blocks < 2) return NULL;
+	
+	readahead_t ra = malloc(sizeof(struct readahead_s));
+	ra->fd = fd;
+	ra->block_size = block_size;
+	ra->depth = blocks;
+	ra->data = malloc((size_t)block_size * blocks);
+	ra->blocks = calloc(blocks, sizeof(block_t));
+	for(unsigned int i = 0; i < blocks; i++) ra->blocks[i].data = ra->data + (size_t)i * block_size;
+	ra->pl = make_pipeline(STAGE_COUNT, blocks);
+	
+	atomic_init(&ra->seek, 0);
+	atomic_init(&ra->seek_offset, offset);
+	atomic_init(&ra->stop, 0);
+	ra->held = 0;
+	ra->next = offset;
+	ra->requested = ra->stalls = 0;
+	
+	pthread_create(&ra->reader, NULL, read_blocks, ra);
+	return ra;
+}
+
+void free_readahead(readahead_t ra){
+	if(!ra) return;
+	
+	// Keep freeing blocks until the helper thread notices it has been stopped
+	atomic_store(&ra->stop, 1);
+	if(ra->held) pipeline_release(ra->pl, STAGE_USE);
+	while(!ra->blocks[pipeline_acquire(ra->pl, STAGE_USE)].last) pipeline_release(ra->pl, STAGE_USE);
+	pthread_join(ra->reader, NULL);
+	
+	free_pipeline(ra->pl);
+	free(ra->blocks);
+	free(ra->data);
+	free(ra);
+}
+
+
+
+unsigned int readahead_get(readahead_t ra, long offset, const uint8_t **data){
+	if(ra->held) pipeline_release(ra->pl, STAGE_USE);
+	ra->held = 0;
+	
+	unsigned int seek = atomic_load(&ra->seek);
+	if(offset != ra->next){
+		atomic_store(&ra->seek_offset, offset);
+		atomic_store_explicit(&ra->seek, ++seek, memory_order_release);
+	}
+	
+	// Skip blocks which were read before the latest request
+	unsigned long stalls = pipeline_stalls(ra->pl, STAGE_USE);
+	block_t *blk;
+	while((blk = ra->blocks + pipeline_acquire(ra->pl, STAGE_USE))->seek != seek){
+		pipeline_release(ra->pl, STAGE_USE);
+	}
+	ra->requested++;
+	if(pipeline_stalls(ra->pl, STAGE_USE) != stalls) ra->stalls++;
+	
+	ra->held = 1;
+	ra->next = blk->offset + blk->len;
+	*data = blk->data;
+	return blk->len;
+}
+
+
+
+unsigned long readahead_blocks(readahead_t ra){
+	return ra->requested;
+}
+
+unsigned long readahead_stalls(readahead_t ra){
+	return ra->stalls;
+}
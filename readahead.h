@@ -0,0 +1,24 @@
+#ifndef _READAHEAD_H
+#define _READAHEAD_H
+
+#include <stdint.h>
+
+struct readahead_s;
+typedef struct readahead_s *readahead_t;
+
+// Read file `fd` in blocks of `block_size` bytes on a helper thread, keeping up to `blocks` - 1 blocks ahead of the reader
+// Reading starts from byte `offset`, `blocks` must be at least 2
+readahead_t make_readahead(int fd, unsigned int block_size, unsigned int blocks, long offset);
+// Stop helper thread, file is not closed
+void free_readahead(readahead_t ra);
+
+// Get block of file starting at byte `offset`, which stays valid until the next call
+// Blocks follow on from the previous one, any other offset restarts reading from there
+// Returns number of bytes in block, zero at the end of the file
+unsigned int readahead_get(readahead_t ra, long offset, const uint8_t **data);
+
+// Get number of blocks which were requested, and of those how many were not read yet and had to be waited on
+unsigned long readahead_blocks(readahead_t ra);
+unsigned long readahead_stalls(readahead_t ra);
+
+#endif
@@ -0,0 +1,237 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "render.h"
+
+
+
+#define CHAR_COUNT 7
+static const char chrs[CHAR_COUNT] = " `'\"*%#";
+#define COLOR_COUNT 4
+static const char *attrs[ATTR_COUNT] = {
+	"\033[0m",         // Plain
+	"\033[0;35;40m",   // Magenta on Black
+	"\033[0;91;45m",   // Red on Magenta
+	"\033[0;93;101m",  // Yellow on Red
+	"\033[0;37;103m",  // White on Yellow
+	"\033[0;7m"        // Inverse
+};
+
+char degree_cell(double scl, int grey, int *attr){
+	int val;
+	if(grey){
+		val = (int)(scl * CHAR_COUNT);
+		if(val < 0) val = 0;
+		if(val >= CHAR_COUNT) val = CHAR_COUNT - 1;
+		
+		*attr = ATTR_PLAIN;
+		return chrs[val];
+	}else{
+		val = (int)(scl * CHAR_COUNT * COLOR_COUNT);
+		if(val < 0) val = 0;
+		if(val >= CHAR_COUNT * COLOR_COUNT) val = CHAR_COUNT * COLOR_COUNT - 1;
+		
+		*attr = 1 + val / CHAR_COUNT;
+		return chrs[val % CHAR_COUNT];
+	}
+}
+
+int format_attr(char *buf, int attr){
+	int len = strlen(attrs[attr]);
+	memcpy(buf, attrs[attr], len);
+	return len;
+}
+
+void pool_columns(const double *ampls, unsigned int bins, double *out, unsigned int count, int mean){
+	unsigned int c, i, from, to, used;
+	double pool;
+	for(c = 0; c < count; c++){
+		from = (unsigned long)c * bins / count;
+		to = (unsigned long)(c + 1) * bins / count;
+		if(to <= from) to = from + 1;
+		
+		pool = 0;
+		used = 0;
+		for(i = from; i < to; i++){
+			if(ampls[i] < 0) continue;
+			if(mean) pool += ampls[i];
+			else if(ampls[i] > pool) pool = ampls[i];
+			used++;
+		}
+		out[c] = used == 0 ? -1 : mean ? pool / used : pool;
+	}
+}
+
+
+
+// Most bytes needed to send one cell, moving the cursor and switching attribute
+#define CELL_MAXLEN (16 + ATTR_MAXLEN + 1)
+// Unchanged cells reprinted instead of moving the cursor past them
+#define SKIP_REPRINT 4
+
+struct screen_s {
+	unsigned int rows, cols;
+	char *chrs;  // Next frame
+	uint8_t *attrs;
+	char *shown_chrs;  // As last sent to terminal
+	uint8_t *shown_attrs;
+	int cleared;  // Whether terminal must be cleared before the next frame is sent
+	
+	char *out;
+	size_t out_len, out_cap, sent;
+};
+
+screen_t make_screen(unsigned int rows, unsigned int cols){
+	screen_t scr = malloc(sizeof(struct screen_s));
+	scr->rows = rows;
+	scr->cols = cols;
+	scr->chrs = malloc(rows * cols);
+	scr->attrs = malloc(rows * cols);
+	scr->shown_chrs = malloc(rows * cols);
+	scr->shown_attrs = malloc(rows * cols);
+	scr->cleared = 1;
+	scr->out_cap = 2 * (size_t)rows * cols + CELL_MAXLEN;
+	scr->out = malloc(scr->out_cap);
+	scr->out_len = scr->sent = 0;
+	screen_erase(scr);
+	return scr;
+}
+
+void free_screen(screen_t scr){
+	if(!scr) return;
+	free(scr->chrs);
+	free(scr->attrs);
+	free(scr->shown_chrs);
+	free(scr->shown_attrs);
+	free(scr->out);
+	free(scr);
+}
+
+
+
+void screen_erase(screen_t scr){
+	memset(scr->chrs, ' ', scr->rows * scr->cols);
+	memset(scr->attrs, ATTR_PLAIN, scr->rows * scr->cols);
+}
+
+void screen_put(screen_t scr, unsigned int row, unsigned int col, char chr, int attr){
+	if(row >= scr->rows || col >= scr->cols) return;
+	scr->chrs[row * scr->cols + col] = chr;
+	scr->attrs[row * scr->cols + col] = attr;
+}
+
+unsigned int screen_print(screen_t scr, unsigned int row, unsigned int col, const char *str, int attr){
+	for(; *str; str++, col++) screen_put(scr, row, col, *str, attr);
+	return col;
+}
+
+
+
+static void emit(screen_t scr, const char *str, size_t len){
+	if(scr->out_len + len > scr->out_cap){
+		scr->out_cap = 2 * (scr->out_len + len);
+		scr->out = realloc(scr->out, scr->out_cap);
+	}
+	memcpy(scr->out + scr->out_len, str, len);
+	scr->out_len += len;
+}
+
+void screen_scroll(screen_t scr, unsigned int first, unsigned int last, int count){
+	if(scr->cleared || last >= scr->rows || first >= last) return;
+	unsigned int height = last - first + 1, shift = count < 0 ? -count : count, r;
+	if(shift == 0 || shift >= height) return;
+	
+	// Line feeds at the bottom of the region and reverse line feeds at its top scroll it on any VT100
+	char buf[48];
+	emit(scr, buf, sprintf(buf, "\033[%u;%ur\033[%u;1H", first + 1, last + 1, (count > 0 ? last : first) + 1));
+	for(r = 0; r < shift; r++) emit(scr, count > 0 ? "\n" : "\033M", count > 0 ? 1 : 2);
+	emit(scr, "\033[r", 3);
+	
+	size_t row = scr->cols, moved = (height - shift) * row;
+	char *chrs = scr->shown_chrs + first * row;
+	uint8_t *attrs = scr->shown_attrs + first * row;
+	if(count > 0){
+		memmove(chrs, chrs + shift * row, moved);
+		memmove(attrs, attrs + shift * row, moved);
+		chrs += moved;
+		attrs += moved;
+	}else{
+		memmove(chrs + shift * row, chrs, moved);
+		memmove(attrs + shift * row, attrs, moved);
+	}
+	memset(chrs, ' ', shift * row);
+	memset(attrs, ATTR_PLAIN, shift * row);
+}
+
+int screen_flush(screen_t scr, int fd, size_t max_bytes){
+	char buf[CELL_MAXLEN];
+	int len, reprint, pending = 0;
+	
+	// Output may already hold scrolling of the terminal
+	
+	// Clearing leaves every cell blank
+	if(scr->cleared){
+		emit(scr, "\033[0m\033[2J", 8);
+		memset(scr->shown_chrs, ' ', scr->rows * scr->cols);
+		memset(scr->shown_attrs, ATTR_PLAIN, scr->rows * scr->cols);
+		scr->cleared = 0;
+	}
+	
+	// Attribute of terminal is plain between flushes, cursor position is not known
+	int attr = ATTR_PLAIN;
+	unsigned int r, c, k, i, at_row = scr->rows, at_col = 0;
+	for(r = 0; r < scr->rows; r++){
+		for(c = 0; c < scr->cols; c++){
+			i = r * scr->cols + c;
+			if(scr->chrs[i] == scr->shown_chrs[i] && scr->attrs[i] == scr->shown_attrs[i]) continue;
+			
+			if(max_bytes && scr->out_len + CELL_MAXLEN + ATTR_MAXLEN > max_bytes){
+				pending = 1;
+				goto done;
+			}
+			
+			// Move cursor unless it is just before a few unchanged cells of the same attribute
+			reprint = 0;
+			if(at_row == r && c - at_col <= SKIP_REPRINT){
+				for(k = at_col; k < c && scr->shown_attrs[r * scr->cols + k] == attr; k++);
+				reprint = k == c;
+			}
+			if(reprint){
+				emit(scr, scr->shown_chrs + r * scr->cols + at_col, c - at_col);
+			}else{
+				len = sprintf(buf, "\033[%u;%uH", r + 1, c + 1);
+				emit(scr, buf, len);
+			}
+			
+			// Attribute is only switched where a run of them changes
+			if(scr->attrs[i] != attr){
+				attr = scr->attrs[i];
+				emit(scr, buf, format_attr(buf, attr));
+			}
+			emit(scr, scr->chrs + i, 1);
+			scr->shown_chrs[i] = scr->chrs[i];
+			scr->shown_attrs[i] = scr->attrs[i];
+			
+			// Cursor position after the last column depends on the terminal
+			at_row = c + 1 < scr->cols ? r : scr->rows;
+			at_col = c + 1;
+		}
+	}
+	
+	done:
+	if(attr != ATTR_PLAIN) emit(scr, buf, format_attr(buf, ATTR_PLAIN));
+	
+	size_t off = 0;
+	ssize_t n;
+	while(off < scr->out_len && (n = write(fd, scr->out + off, scr->out_len - off)) > 0) off += n;
+	scr->sent = scr->out_len;
+	scr->out_len = 0;
+	return pending;
+}
+
+size_t screen_sent(screen_t scr){
+	return scr->sent;
+}
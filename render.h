@@ -0,0 +1,50 @@
+#ifndef _RENDER_H
+#define _RENDER_H
+
+#include <stddef.h>
+
+// Attributes of a character cell, degrees of intensity use the colors in between
+#define ATTR_PLAIN 0
+#define ATTR_INVERSE 5
+#define ATTR_COUNT 6
+
+// Maximum number of bytes written by `format_attr`
+#define ATTR_MAXLEN 16
+
+// Convert `scl` into a character and the attribute it is colored with, which is always plain if `grey`
+// `scl` should be in range [0, 1)
+char degree_cell(double scl, int grey, int *attr);
+// Write escape sequence switching from any attribute to `attr` into `buf`, returns number of bytes written
+int format_attr(char *buf, int attr);
+
+// Pool `bins` amplitudes into `count` columns, each the maximum or if `mean` the mean of the bins it covers
+// Negative amplitudes are unavailable and left out, columns without any are negative
+// When there are more columns than bins, each bin is repeated across the columns it covers
+void pool_columns(const double *ampls, unsigned int bins, double *out, unsigned int count, int mean);
+
+
+struct screen_s;
+typedef struct screen_s *screen_t;
+
+// Model of a terminal of `rows` lines of `cols` cells, which remembers what was last drawn
+// so that only the cells which changed are sent
+screen_t make_screen(unsigned int rows, unsigned int cols);
+void free_screen(screen_t scr);
+
+// Blank every cell of the next frame
+void screen_erase(screen_t scr);
+// Set cell of the next frame, cells outside of the screen are ignored
+void screen_put(screen_t scr, unsigned int row, unsigned int col, char chr, int attr);
+// Set cells from `str` starting at `col`, returns column after the last one set
+unsigned int screen_print(screen_t scr, unsigned int row, unsigned int col, const char *str, int attr);
+// Move what is on the terminal in rows [first, last] up by `count` rows, or down if negative, as a scroll region
+// Rows which are moved in are blank, so a view which scrolls only needs to send them
+void screen_scroll(screen_t scr, unsigned int first, unsigned int last, int count);
+
+// Send the cells of the next frame which differ from the terminal to file descriptor `fd`
+// Stops before exceeding `max_bytes` when it is non-zero, returns non-zero if cells are left to send
+int screen_flush(screen_t scr, int fd, size_t max_bytes);
+// Get number of bytes sent by last flush
+size_t screen_sent(screen_t scr);
+
+#endif
@@ -0,0 +1,480 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "server.h"
+#include "fourier.h"
+
+
+
+#define STREAM_BUFSIZE (1 << 16)  // Number of bytes read from a stream at a time
+#define STREAM_DEPTH 8  // Number of lines of each stream which can be read ahead of its analysis
+#define MAX_EVENTS 64
+
+#define WAVE_FORMAT_PCM 0x0001
+#define WAVE_FORMAT_IEEE_FLOAT 0x0003
+#define WAVE_FORMAT_EXTENSIBLE 0xfffe
+
+typedef struct {
+	sample_t *samps;
+	unsigned long idx;  // Index of first sample within stream
+	struct timespec arrived;  // When the last sample was read
+} hop_t;
+
+typedef struct {
+	unsigned int id;
+	const char *path;
+	int fd;
+	int polled;  // Whether stream is watched by epoll, regular files cannot be and are read whenever possible
+	int paused;  // Whether reading stopped because no line is free to fill
+	int ended;
+
+	// Bytes read which have not been used yet
+	uint8_t *buf;
+	unsigned int buf_len;
+
+	// WAV header, samples follow once `in_data` is set
+	int riff, in_data;
+	unsigned long skip;  // Bytes left in chunk being skipped
+	uint16_t format, channels, bits, align;
+	uint32_t sampfrq;
+
+	freqlist_t lst;
+	spectrum_t spec;
+	unsigned int step;  // Samples per line
+	double *ampls;
+
+	// Ring of lines, [head, tail) are complete and `tail` is being filled
+	// Only the main thread moves `tail` and only the worker analyzing the stream moves `head`
+	hop_t hops[STREAM_DEPTH];
+	unsigned int head, tail, fill;
+	unsigned long idx;  // Number of samples read
+	int busy;  // Whether a worker is analyzing a line of the stream
+	int queued;  // Whether stream is waiting in the ready heap
+
+	unsigned long lines, late;
+	double latency_sum, latency_max;
+} stream_t;
+
+
+static stream_t *streams;
+static unsigned int stream_count;
+static const serve_opts_t *options;
+
+// Streams with a complete line which no worker is analyzing, by the deadline of their oldest line
+static pthread_mutex_t sched_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sched_ready = PTHREAD_COND_INITIALIZER;
+static stream_t **heap;
+static unsigned int heap_len;
+static int stopping;
+static int wake_fd;  // Written by workers when a paused stream has a free line again
+
+static pthread_mutex_t emit_lock = PTHREAD_MUTEX_INITIALIZER;
+static volatile sig_atomic_t serving = 1;  // Cleared by SIGINT
+
+
+
+static double seconds(const struct timespec *ts){
+	return ts->tv_sec + ts->tv_nsec / 1e9;
+}
+
+// Deadline of the oldest complete line of stream
+static double deadline(const stream_t *st){
+	return seconds(&st->hops[st->head % STREAM_DEPTH].arrived) + (double)st->step / st->sampfrq;
+}
+
+static void heap_swap(unsigned int a, unsigned int b){
+	stream_t *tmp = heap[a];
+	heap[a] = heap[b];
+	heap[b] = tmp;
+}
+
+// Add stream to ready heap and wake a worker, `sched_lock` must be held
+static void schedule(stream_t *st){
+	unsigned int i = heap_len++, parent;
+	heap[i] = st;
+	st->queued = 1;
+	for(; i > 0 && deadline(heap[parent = (i - 1) / 2]) > deadline(heap[i]); i = parent) heap_swap(i, parent);
+	pthread_cond_signal(&sched_ready);
+}
+
+// Remove stream with the earliest deadline from ready heap, `sched_lock` must be held
+static stream_t *unschedule(){
+	stream_t *st = heap[0];
+	heap[0] = heap[--heap_len];
+	unsigned int i = 0, child;
+	while((child = 2 * i + 1) < heap_len){
+		if(child + 1 < heap_len && deadline(heap[child + 1]) < deadline(heap[child])) child++;
+		if(deadline(heap[i]) <= deadline(heap[child])) break;
+		heap_swap(i, child);
+		i = child;
+	}
+	st->queued = 0;
+	return st;
+}
+
+
+
+// Analyze lines of any stream, earliest deadline first, until stopped with nothing left to analyze
+static void *work(void *arg){
+	stream_t *st;
+	hop_t *hop;
+	struct timespec now;
+	double latency;
+	unsigned int i;
+	uint64_t one = 1;
+
+	pthread_mutex_lock(&sched_lock);
+	for(;;){
+		while(heap_len == 0 && !stopping) pthread_cond_wait(&sched_ready, &sched_lock);
+		if(heap_len == 0) break;
+		st = unschedule();
+		st->busy = 1;
+		hop = st->hops + st->head % STREAM_DEPTH;
+		pthread_mutex_unlock(&sched_lock);
+
+		if(st->lst) freqlist_pushall(st->lst, st->step, hop->samps);
+		spec_pushall(st->spec, st->step, hop->samps);
+		for(i = 0; i < options->freqs_len; i++) st->ampls[i] = freqlist_get(st->lst, i);
+		spec_getall(st->spec, st->ampls + options->freqs_len, options->feats_len, options->feats, st->ampls + options->freqs_len + options->frq_count);
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		latency = seconds(&now) - seconds(&hop->arrived);
+		if(seconds(&now) > deadline(st)) st->late++;
+		st->latency_sum += latency;
+		if(latency > st->latency_max) st->latency_max = latency;
+		st->lines++;
+
+		pthread_mutex_lock(&emit_lock);
+		options->emit(st->id, (double)hop->idx / st->sampfrq, st->ampls);
+		pthread_mutex_unlock(&emit_lock);
+
+		pthread_mutex_lock(&sched_lock);
+		st->head++;
+		st->busy = 0;
+		if(st->head != st->tail) schedule(st);
+		if(st->paused) write(wake_fd, &one, sizeof(one));
+	}
+	pthread_mutex_unlock(&sched_lock);
+	return NULL;
+}
+
+
+
+static int32_t le_int(const uint8_t *bytes, int count){
+	uint32_t val = 0;
+	for(int i = count - 1; i >= 0; i--) val = (val << 8) | bytes[i];
+	return (int32_t)(val << (32 - 8 * count)) >> (32 - 8 * count);
+}
+
+// Read selected channel of sample frame as a value in [-1, 1)
+static double decode_sample(const stream_t *st, const uint8_t *frame){
+	const uint8_t *samp = frame + options->channel * (st->bits / 8);
+	float f;
+	double d;
+	if(st->format == WAVE_FORMAT_IEEE_FLOAT){
+		if(st->bits == 32){
+			memcpy(&f, samp, 4);
+			return f;
+		}
+		memcpy(&d, samp, 8);
+		return d;
+	}
+	if(st->bits == 8) return (samp[0] - 128) / 128.0;  // Only unsigned size
+	return le_int(samp, st->bits / 8) / (double)(1u << (st->bits - 1));
+}
+
+// Allocate analysis of stream once its format is known, returns non-zero if spectrum is invalid at its sampling frequency
+// Spectrum shares its wave data with any other stream of the same sampling frequency
+static int setup_stream(stream_t *st){
+	double maxdur = options->window_dur > 0 ? options->window_dur : 1 / options->lines_per_sec;
+	spec_cost_t costs[SPEC_ENGINES];
+	int engine;
+	
+	st->step = (unsigned int)(st->sampfrq / options->lines_per_sec);
+	if(st->step < 1) st->step = 1;
+
+	st->spec = NULL;
+	for(unsigned int i = 0; i < stream_count && !st->spec; i++){
+		if(streams + i != st && streams[i].spec && streams[i].sampfrq == st->sampfrq) st->spec = share_spectrum(streams[i].spec);
+	}
+	if(!st->spec){
+		engine = options->engine >= 0 ? options->engine
+			: spec_plan(st->sampfrq, options->low_frq, options->upp_frq, options->frq_count, maxdur, st->step, 0, costs);
+		st->spec = gen_spectrum_with(engine, st->sampfrq, options->low_frq, options->upp_frq, options->frq_count, maxdur);
+		if(!st->spec){
+			fprintf(stderr, "Stream %u: %s\t\tInvalid frequency range: %.1lfHz : %.1lfHz\n", st->id, st->path, options->low_frq, options->upp_frq);
+			return 1;
+		}
+		if(options->tile_bins >= 0){
+			spec_set_tile(st->spec, options->tile_bins, options->tile_samps > 0 ? options->tile_samps : spec_tile_samps(st->spec));
+		}
+	}
+	st->lst = options->freqs_len > 0 ? gen_freqlist(st->sampfrq, options->freqs_len, options->freqs, maxdur) : NULL;
+
+	sample_t *samps = malloc(sizeof(sample_t) * st->step * STREAM_DEPTH);
+	for(unsigned int i = 0; i < STREAM_DEPTH; i++) st->hops[i].samps = samps + i * st->step;
+	st->ampls = malloc(sizeof(double) * (options->freqs_len + options->frq_count + options->feats_len));
+
+	fprintf(stderr, "Stream %u: %s\t\tSampling Frequency: %uHz\t\tChannels: %u\n", st->id, st->path, st->sampfrq, st->channels);
+	return 0;
+}
+
+// Parse as much of the WAV header as is buffered, returns number of bytes used
+// Returns -1 if stream is not a supported WAV stream or -2 if it cannot be analyzed
+static int parse_header(stream_t *st){
+	unsigned int pos = 0, size, n;
+	const uint8_t *chunk;
+	if(!st->riff){
+		if(st->buf_len < 12) return 0;
+		if(memcmp(st->buf, "RIFF", 4) != 0 || memcmp(st->buf + 8, "WAVE", 4) != 0) return -1;
+		st->riff = 1;
+		pos = 12;
+	}
+
+	while(!st->in_data){
+		if(st->skip > 0){
+			n = st->buf_len - pos < st->skip ? st->buf_len - pos : st->skip;
+			pos += n;
+			st->skip -= n;
+			if(st->skip > 0) break;
+			continue;
+		}
+		if(st->buf_len - pos < 8) break;
+
+		// Length of data chunk is ignored since streams may not know it
+		chunk = st->buf + pos;
+		size = (uint32_t)le_int(chunk + 4, 4);
+		if(memcmp(chunk, "data", 4) == 0){
+			if(!st->align) return -1;  // No format chunk
+			pos += 8;
+			if(setup_stream(st)) return -2;
+			st->in_data = 1;
+			break;
+		}
+		if(memcmp(chunk, "fmt ", 4) == 0){
+			if(size < 16 || size > STREAM_BUFSIZE - 8) return -1;
+			if(st->buf_len - pos < 8 + size) break;
+
+			st->format = le_int(chunk + 8, 2) & 0xffff;
+			st->channels = le_int(chunk + 10, 2);
+			st->sampfrq = (uint32_t)le_int(chunk + 12, 4);
+			st->bits = le_int(chunk + 22, 2);
+			if(st->format == WAVE_FORMAT_EXTENSIBLE && size >= 26) st->format = le_int(chunk + 32, 2) & 0xffff;  // From sub-format
+
+			if(st->format == WAVE_FORMAT_PCM){
+				if(st->bits != 8 && st->bits != 16 && st->bits != 24 && st->bits != 32) return -1;
+			}else if(st->format == WAVE_FORMAT_IEEE_FLOAT){
+				if(st->bits != 32 && st->bits != 64) return -1;
+			}else{
+				return -1;
+			}
+			if(st->sampfrq == 0 || options->channel >= st->channels) return -1;
+			st->align = st->channels * (st->bits / 8);
+		}
+		pos += 8;
+		st->skip = size + (size & 1);  // Chunks are padded to an even length
+	}
+	return pos;
+}
+
+// Stop reading stream, lines already complete are still analyzed
+static void end_stream(stream_t *st, int epfd){
+	if(st->polled && !st->paused) epoll_ctl(epfd, EPOLL_CTL_DEL, st->fd, NULL);
+	close(st->fd);
+	st->ended = 1;
+}
+
+// Pause or resume waiting for stream to be readable
+// A paused stream is removed from epoll entirely, since hangups are reported even with no events requested
+static void watch_stream(stream_t *st, int epfd, int watch){
+	if(!st->polled) return;
+	struct epoll_event ev = {0};
+	ev.events = EPOLLIN;
+	ev.data.ptr = st;
+	epoll_ctl(epfd, watch ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, st->fd, &ev);
+}
+
+// Convert buffered bytes into lines until they run out or every line is waiting for analysis
+static void consume(stream_t *st, int epfd){
+	int pos = 0;
+	if(!st->in_data && (pos = parse_header(st)) < 0){
+		if(pos == -1) fprintf(stderr, "Stream %u: %s\t\tUnsupported or not a WAV stream\n", st->id, st->path);
+		st->buf_len = 0;
+		end_stream(st, epfd);
+		return;
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	hop_t *hop;
+	while(st->in_data && st->buf_len - pos >= st->align){
+		// Make sure the next line is free before filling it
+		if(st->fill == 0){
+			pthread_mutex_lock(&sched_lock);
+			if(st->tail - st->head >= STREAM_DEPTH){
+				st->paused = 1;
+				pthread_mutex_unlock(&sched_lock);
+				watch_stream(st, epfd, 0);
+				break;
+			}
+			pthread_mutex_unlock(&sched_lock);
+			st->hops[st->tail % STREAM_DEPTH].idx = st->idx;
+		}
+
+		hop = st->hops + st->tail % STREAM_DEPTH;
+		hop->samps[st->fill++] = decode_sample(st, st->buf + pos);
+		pos += st->align;
+		st->idx++;
+
+		if(st->fill == st->step){
+			hop->arrived = now;
+			st->fill = 0;
+			pthread_mutex_lock(&sched_lock);
+			st->tail++;
+			if(!st->busy && !st->queued) schedule(st);
+			pthread_mutex_unlock(&sched_lock);
+		}
+	}
+
+	memmove(st->buf, st->buf + pos, st->buf_len - pos);
+	st->buf_len -= pos;
+}
+
+static void read_stream(stream_t *st, int epfd){
+	ssize_t len = read(st->fd, st->buf + st->buf_len, STREAM_BUFSIZE - st->buf_len);
+	if(len < 0 && (errno == EAGAIN || errno == EINTR)) return;
+	if(len <= 0){
+		end_stream(st, epfd);
+		return;
+	}
+	st->buf_len += len;
+	consume(st, epfd);
+}
+
+static void on_interrupt(int sig){
+	serving = 0;
+}
+
+
+
+int serve_streams(unsigned int count, char *const *paths, const serve_opts_t *opts){
+	unsigned int i, workers = opts->workers > 0 ? opts->workers : 1;
+	options = opts;
+	stream_count = count;
+	streams = calloc(count, sizeof(stream_t));
+	heap = malloc(sizeof(stream_t*) * count);
+	heap_len = 0;
+	stopping = 0;
+
+	int epfd = epoll_create1(0);
+	wake_fd = eventfd(0, EFD_NONBLOCK);
+	struct epoll_event ev = {0};
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, wake_fd, &ev);
+
+	stream_t *st;
+	for(i = 0; i < count; i++){
+		st = streams + i;
+		st->id = i;
+		st->path = paths[i];
+
+		// Opening a FIFO without blocking does not wait for its writer
+		if((st->fd = open(paths[i], O_RDONLY | O_NONBLOCK)) < 0){
+			printf("Could not open stream: \"%s\"\n", paths[i]);
+			while(i-- > 0) close(streams[i].fd);
+			close(epfd);
+			close(wake_fd);
+			free(heap);
+			free(streams);
+			return 1;
+		}
+		st->buf = malloc(STREAM_BUFSIZE);
+		ev.data.ptr = st;
+		st->polled = epoll_ctl(epfd, EPOLL_CTL_ADD, st->fd, &ev) == 0;
+	}
+
+	struct sigaction act = {0}, old;
+	act.sa_handler = on_interrupt;
+	sigaction(SIGINT, &act, &old);
+
+	pthread_t threads[workers];
+	for(i = 0; i < workers; i++) pthread_create(threads + i, NULL, work, NULL);
+
+	struct epoll_event events[MAX_EVENTS];
+	int n, e, busy;
+	uint64_t wakes;
+	unsigned int active = count;
+	while(serving && active > 0){
+		// Regular files are always readable so only wait when none of them can be read
+		busy = 0;
+		for(i = 0; i < count; i++) if(!streams[i].polled && !streams[i].ended && !streams[i].paused) busy = 1;
+
+		n = epoll_wait(epfd, events, MAX_EVENTS, busy ? 0 : -1);
+		if(n < 0 && errno != EINTR) break;
+		for(e = 0; e < n; e++){
+			st = events[e].data.ptr;
+			if(st){
+				if(!st->ended && !st->paused) read_stream(st, epfd);
+				continue;
+			}
+
+			// Lines were freed, resume streams which have room again
+			read(wake_fd, &wakes, sizeof(wakes));
+			for(i = 0; i < count; i++){
+				st = streams + i;
+				if(!st->paused) continue;
+				pthread_mutex_lock(&sched_lock);
+				if(st->tail - st->head < STREAM_DEPTH) st->paused = 0;
+				pthread_mutex_unlock(&sched_lock);
+				if(st->paused || st->ended) continue;
+				watch_stream(st, epfd, 1);
+				consume(st, epfd);
+			}
+		}
+		for(i = 0; i < count; i++){
+			st = streams + i;
+			if(!st->polled && !st->ended && !st->paused) read_stream(st, epfd);
+		}
+
+		active = 0;
+		for(i = 0; i < count; i++) if(!streams[i].ended) active++;
+	}
+
+	// Finish analyzing complete lines
+	pthread_mutex_lock(&sched_lock);
+	stopping = 1;
+	pthread_cond_broadcast(&sched_ready);
+	pthread_mutex_unlock(&sched_lock);
+	for(i = 0; i < workers; i++) pthread_join(threads[i], NULL);
+	sigaction(SIGINT, &old, NULL);
+
+	for(i = 0; i < count; i++){
+		st = streams + i;
+		fprintf(stderr, "Stream %u: %s\t\tLines: %lu\t\tLatency: %.2lfms mean, %.2lfms max\t\tLate: %lu\n",
+			st->id, st->path, st->lines, st->lines ? 1000 * st->latency_sum / st->lines : 0, 1000 * st->latency_max, st->late
+		);
+
+		if(!st->ended) close(st->fd);
+		if(st->spec) free_spectrum(st->spec);
+		if(st->lst) free_freqlist(st->lst);
+		if(st->in_data) free(st->hops[0].samps);
+		free(st->ampls);
+		free(st->buf);
+	}
+	close(epfd);
+	close(wake_fd);
+	free(heap);
+	free(streams);
+	return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef _SERVER_H
+#define _SERVER_H
+
+#include "fourier.h"
+
+// Analysis shared by every stream
+typedef struct {
+	double low_frq, upp_frq;  // Range of spectrum
+	int frq_count;  // Number of tables in spectrum
+	unsigned int freqs_len;  // Number of extra frequencies tracked
+	const double *freqs;
+	double lines_per_sec;  // Lines analyzed each second of a stream
+	double window_dur;  // Duration analyzed for each line, non-positive uses the time between lines
+	int engine;  // Engine computing spectra, negative plans the cheapest accurate one for each sampling frequency
+	int tile_bins, tile_samps;  // Tile size of spectrum updates, negative chooses automatically
+	int channel;  // Channel of each stream analyzed
+	unsigned int feats_len;  // Number of features of the spectrum computed after its amplitudes
+	const spec_feature_t *feats;
+	unsigned int workers;  // Number of threads analyzing lines
+	
+	// Called with the amplitudes of each line of stream `stream`, tracked frequencies first and features last
+	// Calls are never concurrent and lines of each stream come in order
+	void (*emit)(unsigned int stream, double time, const double *ampls);
+} serve_opts_t;
+
+// Analyze WAV data arriving on each of `count` pipes, FIFOs or files in `paths` from one process
+// Reads every stream as data arrives and analyzes each line once complete on a pool of worker threads,
+// earliest deadline first, where a line's deadline is the time its last sample arrived plus the time between lines
+// Streams with the same sampling frequency share wave data
+// Runs until every stream has ended or SIGINT, then prints latency statistics of each stream to stderr
+// Returns non-zero if a stream could not be opened
+int serve_streams(unsigned int count, char *const *paths, const serve_opts_t *opts);
+
+#endif
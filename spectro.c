@@ -1,12 +1,24 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
 #include <alsa/asoundlib.h>
 #include <math.h>
 #include <argp.h>
+#include <pthread.h>
 
 #include "fourier.h"
+#include "pipeline.h"
+#include "publish.h"
+#include "pyramid.h"
+#include "render.h"
+#include "server.h"
+#include "tui.h"
 #include "wav.h"
 
 
@@ -22,56 +34,218 @@ double *freqs = NULL;
 double low_frq = 10, upp_frq = 10000;  // Lower and Upper Bounds of Frequency Range
 int frq_count = -1;  // Number of Frequency Tables in Spectrum
 float lines_per_sec = 4;  // Number of lines of spectrogram to print every second
+float window_dur = -1;  // Duration of analysis window, negative uses the time between lines
 float scaling = 100;  // Amount by which to scale resulting amplitudes
 
 int do_playback = 0;  // Whether application should playback audio as it's running
 int is_grey = 0;  // Whether the output is uncolored
+int is_interactive = 0;  // Whether to explore the file in an interactive viewer
+
+char *capture_dev = NULL;  // ALSA device to capture from instead of reading an audio file
+unsigned int capture_freq = 44100;  // Sampling frequency requested from capture device
+unsigned int capture_period = 1024;  // Number of frames read from capture device at a time
+
+char pyramid_file[AUDIO_FILE_LENGTH + 4] = "\0";  // Path to summary pyramid of audio file
+float summary_rate = 20;  // Number of frames per second at finest level of summary pyramid
+pool_t pool_mode = POOL_MAX;  // How amplitudes are combined when summarizing
+
+#define OPT_PYRAMID_RATE 0x100
+#define OPT_POOL 0x101
+#define OPT_TILE 0x102
+#define OPT_GATE 0x103
+#define OPT_WINDOW 0x104
+#define OPT_QUEUE 0x105
+#define OPT_READ_AHEAD 0x106
+#define OPT_PUBLISH 0x107
+#define OPT_REFRESH_BYTES 0x108
+#define OPT_STREAM 0x109
+#define OPT_WORKERS 0x10a
+#define OPT_ENGINE 0x10b
+#define OPT_MEMORY_BUDGET 0x10c
+#define OPT_EXPLAIN 0x10d
+#define OPT_FIT 0x10e
+#define OPT_FEATURE 0x10f
+#define OPT_FEATURES_ONLY 0x110
+#define OPT_PUBLISH_REPLACE 0x111
+
+#define FIT_BINS 256  // Number of frequencies analyzed by default when fitting lines to the terminal
+
+#define PUBLISH_SLOTS 1024  // Number of lines kept in shared memory for readers to catch up on
+
+int tile_bins = -1, tile_samps = -1;  // Size of tiles used to update spectrum, negative chooses automatically
+double gate_level = -1;  // RMS level below which lines are silent, negative disables gating
+unsigned int queue_len = 4;  // Number of lines each stage may work ahead of the next, zero runs stages in turn
+char *publish_name = NULL;  // Name of shared memory object lines are published to
+int publish_replace = 0;  // Whether an existing shared memory object of the same name is replaced
+publisher_t publisher = NULL;
+unsigned long refresh_bytes = 0;  // Most bytes sent to terminal at once by interactive viewer, zero for no limit
+unsigned int read_ahead = 16;  // Number of lines of streamed input read ahead on a helper thread, zero reads as samples are decoded
+
+unsigned int streams_len = 0, streams_cap = 0;
+char **streams = NULL;  // Paths of WAV streams analyzed together by one server instead of an audio file
+unsigned int workers = 0;  // Number of threads analyzing streams, zero uses one per processor
+
+const char *engine_names[SPEC_ENGINES] = {"tables", "phasors"};
+int engine = -1;  // Engine computing spectrum, negative chooses the cheapest accurate one
+unsigned long memory_budget = 0;  // Most bytes analysis may allocate, zero for no limit
+int do_explain = 0;  // Whether to print the estimated cost of each engine instead of analyzing
+
+int fit_columns = 0;  // Whether lines are pooled into the width of the terminal, following resizes
+unsigned int columns;  // Number of columns the spectrum is printed in
+volatile sig_atomic_t resized = 0;  // Set by SIGWINCH
+const double *header_freqs;  // Tracked frequencies labeled by the last headers, to print them again
+
+unsigned int feats_len = 0, feats_cap = 0;
+spec_feature_t *feats = NULL;  // Features of the spectrum printed after it, computed while collecting amplitudes
+int features_only = 0;  // Whether only the features of the spectrum are printed
 
 struct argp_option options[] = {
 	{"freq", 'f', "FREQ", 0, "Track another frequency precisely", 0},
+	{"freq-file", 'F', "FILE", 0, "Track every frequency listed in FILE, separated by whitespace", 0},
 	
 	{"count", 'n', "NUMBER", 0, "Number of Frequencies to be track in Spectrum. Defaults to fit screen", 1},
 	{"range", 'a', "[LOW_FREQ][:HIGH_FREQ]", 0, "Lower and Upper Bounding Frequency of Spectrum (default: 10Hz : 10,000Hz)", 1},
+	{"tile", OPT_TILE, "BINS[:SAMPLES]", 0, "Number of frequencies and samples updated together. Defaults to fit cache, 0 disables tiling", 1},
+	{"gate", OPT_GATE, "DBFS", 0, "Skip analysis while every window only contains lines whose RMS level is below DBFS and print them blank (e.g. -60)", 1},
+	{"engine", OPT_ENGINE, "auto|tables|phasors", 0, "How the spectrum is computed. auto picks the accurate engine needing the fewest operations within the memory budget (default: auto)", 1},
+	{"memory-budget", OPT_MEMORY_BUDGET, "BYTES", 0, "Most memory the analysis may use, with an optional K, M or G suffix. Fails before analyzing when no engine fits. Defaults to no limit", 1},
+	{"explain", OPT_EXPLAIN, 0, 0, "Print the estimated memory, operations and accuracy of each engine and which would be used, then exit", 1},
+	{"fit", OPT_FIT, 0, 0, "Analyze a fixed number of frequencies (default: 256) and pool them into the width of the terminal with --pool, printing new headers when it is resized", 1},
+	{"feature", OPT_FEATURE, "centroid|peak|flux|band:LOW:HIGH", 0, "Also print a feature of each line of the spectrum: the centroid or peak frequency, the flux since the previous line or the energy between LOW and HIGH Hz", 1},
+	{"features-only", OPT_FEATURES_ONLY, 0, 0, "Print the features of the spectrum instead of its amplitudes", 1},
 	{"grey", 'g', 0, 0, "Output spectrogram should be displayed without color (Used for terminals that don't support colored ASCII)", 1},
 	
 	{"channel", 'c', "CHANNEL", 0, "Channel of audio file to display. Defaults to first", 1},
 	{"time", 't', "[START][:END]", 0, "Start and End Times in seconds to display spectrogram for. Defaults to entire file", 1},
 	
 	{"rate", 'r', "LINES_PER_SEC", 0, "Rate at which spectrogram lines should be printed (default: 4 lines / sec)", 3},
+	{"window", OPT_WINDOW, "SECONDS", 0, "Duration of samples analyzed for each line. Only those samples are decoded when shorter than the time between lines (default: 1 / LINES_PER_SEC)", 3},
 	{"scale", 's', "SCALING", 0, "Factor by which to scale resulting amplitude values [1] (default: 100)", 3},
+	{"queue", OPT_QUEUE, "LINES", 0, "Read, analyze and print lines on separate threads, letting each work up to LINES lines ahead of the next. 0 runs them in turn on one thread (default: 4)", 3},
+	{"read-ahead", OPT_READ_AHEAD, "LINES", 0, "Read FLAC input on a helper thread, keeping about LINES lines of it buffered ahead of decoding. 0 reads it only once it is needed (default: 16)", 3},
+	{"publish", OPT_PUBLISH, "NAME", 0, "Also write the amplitudes of each line to a ring in POSIX shared memory NAME (e.g. /spectro) which any number of local programs can read", 3},
+	{"publish-replace", OPT_PUBLISH_REPLACE, 0, 0, "Replace shared memory object NAME if it already exists, such as one left behind by a killed publisher. Readers of the old object keep their copy", 3},
 	{"playback", 'p', 0, 0, "Plays audio as it is displaying the spectrogram", 3},
+	{"interactive", 'i', 0, 0, "Explore audio file in an interactive viewer. Scroll with arrow keys, zoom time with +/-, zoom frequencies with [/], scale with </> and quit with q", 3},
+	{"refresh-bytes", OPT_REFRESH_BYTES, "BYTES", 0, "Most bytes the interactive viewer sends to the terminal at once, the rest of a redraw follows shortly after (e.g. 4096 over slow links). Defaults to no limit", 3},
+	
+	{"capture", 'C', "DEVICE", OPTION_ARG_OPTIONAL, "Display spectrogram of audio captured live from ALSA device instead of a file (default device: \"default\")", 2},
+	{"sample-rate", 'R', "HZ", 0, "Sampling frequency requested from capture device (default: 44100Hz)", 2},
+	{"period", 'P', "FRAMES", 0, "Number of frames read from capture device at a time (default: 1024)", 2},
+	
+	{"pyramid", 'Y', "FILE", OPTION_ARG_OPTIONAL, "Render from a summary pyramid stored in FILE, building it if missing or out of date (default: FILE.pyr)", 4},
+	{"pyramid-rate", OPT_PYRAMID_RATE, "FRAMES_PER_SEC", 0, "Resolution of finest level of summary pyramid (default: 20 frames / sec)", 4},
+	{"pool", OPT_POOL, "max|mean", 0, "How frames are combined when summarizing and frequencies are combined by --fit (default: max)", 4},
+	
+	{"stream", OPT_STREAM, "PATH", 0, "Analyze WAV data arriving on pipe or FIFO PATH live, together with every other stream given, instead of an audio file. Lines are labeled with the index of their stream", 5},
+	{"workers", OPT_WORKERS, "THREADS", 0, "Number of threads analyzing streams (default: one per processor)", 5},
 	{0}
 };
 
+// Add frequency to array of extra frequencies
+void add_freq(double frq){
+	if(freqs_len >= freqs_cap){
+		if(freqs_cap == 0) freqs_cap = 1;
+		else freqs_cap *= 2;
+		freqs = realloc(freqs, sizeof(double) * freqs_cap);
+	}
+	
+	freqs[freqs_len++] = frq;
+}
+
+// Add feature to array of features of the spectrum
+void add_feature(feat_kind_t kind, double low, double high){
+	if(feats_len >= feats_cap){
+		if(feats_cap == 0) feats_cap = 1;
+		else feats_cap *= 2;
+		feats = realloc(feats, sizeof(spec_feature_t) * feats_cap);
+	}
+	
+	feats[feats_len].kind = kind;
+	feats[feats_len].low = low;
+	feats[feats_len].high = high;
+	feats_len++;
+}
+
+// Add path to array of streams
+void add_stream(char *path){
+	if(streams_len >= streams_cap){
+		if(streams_cap == 0) streams_cap = 1;
+		else streams_cap *= 2;
+		streams = realloc(streams, sizeof(char*) * streams_cap);
+	}
+	
+	streams[streams_len++] = path;
+}
+
 error_t parse_opt(int key, char *arg, struct argp_state *state){
-	double frq;
+	double frq, size;
+	char unit;
 	int fst, snd;
+	FILE *fl;
 	switch(key){
 		case ARGP_KEY_ARG:
 			strncpy(audio_file, arg, AUDIO_FILE_LENGTH);
 		break;
 		case ARGP_KEY_END:
-			if(!*audio_file){  // When no audio file is given
+			if(!*audio_file && !capture_dev && streams_len == 0){  // When no audio file is given
 				printf("Audio source must be given to analyze\n");
 				argp_usage(state);
 			}
+			if(*pyramid_file && capture_dev){
+				printf("Summary pyramid can only be used with audio files\n");
+				argp_usage(state);
+			}
+			if(*pyramid_file && window_dur > 0){
+				printf("Summary pyramid is always analyzed with windows of its own resolution\n");
+				argp_usage(state);
+			}
+			if(is_interactive && (capture_dev || *pyramid_file || freqs_len > 0 || do_playback || gate_level >= 0 || window_dur > 0 || publish_name || engine >= 0 || memory_budget || do_explain || fit_columns || feats_len > 0)){
+				printf("Interactive viewer only supports displaying the spectrum of audio files\n");
+				argp_usage(state);
+			}
+			if(streams_len > 0 && (*audio_file || capture_dev || *pyramid_file || is_interactive || do_playback || gate_level >= 0 || publish_name || memory_budget || do_explain)){
+				printf("Streams are analyzed on their own and only support printing their lines\n");
+				argp_usage(state);
+			}
+			if(publish_replace && !publish_name){
+				printf("Shared memory object to replace must be given with --publish\n");
+				argp_usage(state);
+			}
+			if(features_only && feats_len == 0){
+				printf("Features must be given with --feature to print only them\n");
+				argp_usage(state);
+			}
+			if(feats_len > 0 && (*pyramid_file || (features_only && fit_columns))){
+				printf("Features are only computed while analyzing and are printed in columns of their own\n");
+				argp_usage(state);
+			}
+			if(strcmp(pyramid_file, "-") == 0){
+				snprintf(pyramid_file, AUDIO_FILE_LENGTH + 4, "%s.pyr", audio_file);
+			}
 		break;
 		
 		case 'f':
-			if(sscanf(arg, " %lf", &frq) < 1){
-				printf("Frequency must be floating point: \"%s\"\n", arg);
+			if(sscanf(arg, " %lf", &frq) < 1 || frq <= 0){
+				printf("Frequency must be positive floating point: \"%s\"\n", arg);
 				argp_usage(state);
 			}else{
-				// Add frequency to array
-				if(freqs_len >= freqs_cap){
-					if(freqs_cap == 0) freqs_cap = 1;
-					else freqs_cap *= 2;
-					freqs = realloc(freqs, freqs_cap);
-				}
-				
-				freqs[freqs_len++] = frq;
+				add_freq(frq);
 			}
 		break;
+		case 'F':
+			if(!(fl = fopen(arg, "r"))){
+				printf("Could not open frequency list: \"%s\"\n", arg);
+				argp_usage(state);
+			}
+			while(fscanf(fl, " %lf", &frq) == 1 && frq > 0) add_freq(frq);
+			if(!feof(fl)){
+				printf("Frequency list must contain positive floating point numbers: \"%s\"\n", arg);
+				fclose(fl);
+				argp_usage(state);
+			}
+			fclose(fl);
+		break;
 		
 		case 'n':
 			if(sscanf(arg, " %i", &frq_count) < 1){
@@ -87,6 +261,58 @@ error_t parse_opt(int key, char *arg, struct argp_state *state){
 				argp_usage(state);
 			}
 		break;
+		case OPT_TILE:
+			if(sscanf(arg, "%i", &tile_bins) < 1 || tile_bins < 0){
+				printf("Invalid tile size, must be non-negative integer: \"%s\"\n", arg);
+				argp_usage(state);
+			}
+			if(sscanf(arg, "%*[^:]:%i", &tile_samps) == 1 && tile_samps <= 0){
+				printf("Invalid number of samples in tile, must be positive integer: \"%s\"\n", arg);
+				argp_usage(state);
+			}
+		break;
+		case OPT_ENGINE:
+			engine = -1;
+			for(fst = 0; fst < SPEC_ENGINES; fst++) if(strcmp(arg, engine_names[fst]) == 0) engine = fst;
+			if(engine < 0 && strcmp(arg, "auto") != 0){
+				printf("Invalid engine, must be \"auto\", \"tables\" or \"phasors\": \"%s\"\n", arg);
+				argp_usage(state);
+			}
+		break;
+		case OPT_MEMORY_BUDGET:
+			unit = 0;
+			if(sscanf(arg, " %lf%c", &size, &unit) < 1 || size <= 0 || (unit && !strchr("KkMmGg", unit))){
+				printf("Invalid memory budget, must be positive number of bytes with an optional K, M or G suffix: \"%s\"\n", arg);
+				argp_usage(state);
+			}
+			if(unit == 'K' || unit == 'k') size *= 1 << 10;
+			if(unit == 'M' || unit == 'm') size *= 1 << 20;
+			if(unit == 'G' || unit == 'g') size *= 1 << 30;
+			memory_budget = (unsigned long)size;
+		break;
+		case OPT_EXPLAIN: do_explain = 1;
+		break;
+		case OPT_FIT: fit_columns = 1;
+		break;
+		case OPT_FEATURE:
+			if(strcmp(arg, "centroid") == 0) add_feature(FEAT_CENTROID, 0, 0);
+			else if(strcmp(arg, "peak") == 0) add_feature(FEAT_PEAK, 0, 0);
+			else if(strcmp(arg, "flux") == 0) add_feature(FEAT_FLUX, 0, 0);
+			else if(sscanf(arg, "band:%lf:%lf", &frq, &size) == 2 && frq >= 0 && size > frq) add_feature(FEAT_BAND, frq, size);
+			else{
+				printf("Invalid feature, must be \"centroid\", \"peak\", \"flux\" or \"band:LOW:HIGH\" with LOW < HIGH: \"%s\"\n", arg);
+				argp_usage(state);
+			}
+		break;
+		case OPT_FEATURES_ONLY: features_only = 1;
+		break;
+		case OPT_GATE:
+			if(sscanf(arg, " %lf", &gate_level) < 1 || !isfinite(gate_level)){
+				printf("Invalid gate level, must be float in dBFS: \"%s\"\n", arg);
+				argp_usage(state);
+			}
+			gate_level = pow(10, gate_level / 20);
+		break;
 		case 'g': is_grey = 1;
 		break;
 		
@@ -111,14 +337,88 @@ error_t parse_opt(int key, char *arg, struct argp_state *state){
 				argp_usage(state);
 			}
 		break;
+		case OPT_WINDOW:
+			if(sscanf(arg, " %f", &window_dur) < 1 || window_dur <= 0){
+				printf("Invalid window duration, must be positive float: \"%s\"\n", arg);
+				argp_usage(state);
+			}
+		break;
 		case 's':
 			if(sscanf(arg, " %f", &scaling) < 1){
 				printf("Invalid scaling, must be float: \"%s\"\n", arg);
 				argp_usage(state);
 			}
 		break;
+		case OPT_QUEUE:
+			if(sscanf(arg, " %u", &queue_len) < 1){
+				printf("Invalid queue length, must be non-negative integer: \"%s\"\n", arg);
+				argp_usage(state);
+			}
+		break;
+		case OPT_READ_AHEAD:
+			if(sscanf(arg, " %u", &read_ahead) < 1){
+				printf("Invalid read-ahead, must be non-negative integer: \"%s\"\n", arg);
+				argp_usage(state);
+			}
+		break;
+		case OPT_PUBLISH: publish_name = arg;
+		break;
+		case OPT_PUBLISH_REPLACE: publish_replace = 1;
+		break;
 		case 'p': do_playback = 1;
 		break;
+		case 'i': is_interactive = 1;
+		break;
+		case OPT_REFRESH_BYTES:
+			if(sscanf(arg, " %lu", &refresh_bytes) < 1 || (refresh_bytes > 0 && refresh_bytes < 256)){
+				printf("Invalid refresh limit, must be 0 or at least 256 bytes: \"%s\"\n", arg);
+				argp_usage(state);
+			}
+		break;
+		
+		case 'C': capture_dev = arg ? arg : "default";
+		break;
+		case 'R':
+			if(sscanf(arg, " %u", &capture_freq) < 1 || capture_freq == 0){
+				printf("Invalid sampling frequency, must be positive integer: \"%s\"\n", arg);
+				argp_usage(state);
+			}
+		break;
+		case 'P':
+			if(sscanf(arg, " %u", &capture_period) < 1 || capture_period == 0){
+				printf("Invalid period size, must be positive integer: \"%s\"\n", arg);
+				argp_usage(state);
+			}
+		break;
+		
+		case 'Y':
+			// Empty path indicates that it should be derived from the audio file
+			strncpy(pyramid_file, arg ? arg : "", AUDIO_FILE_LENGTH + 4);
+			if(!*pyramid_file) strcpy(pyramid_file, "-");
+		break;
+		case OPT_PYRAMID_RATE:
+			if(sscanf(arg, " %f", &summary_rate) < 1 || summary_rate <= 0){
+				printf("Invalid pyramid resolution, must be positive float: \"%s\"\n", arg);
+				argp_usage(state);
+			}
+		break;
+		case OPT_STREAM: add_stream(arg);
+		break;
+		case OPT_WORKERS:
+			if(sscanf(arg, " %u", &workers) < 1 || workers == 0){
+				printf("Invalid number of workers, must be positive integer: \"%s\"\n", arg);
+				argp_usage(state);
+			}
+		break;
+		
+		case OPT_POOL:
+			if(strcmp(arg, "max") == 0) pool_mode = POOL_MAX;
+			else if(strcmp(arg, "mean") == 0) pool_mode = POOL_MEAN;
+			else{
+				printf("Invalid pooling, must be \"max\" or \"mean\": \"%s\"\n", arg);
+				argp_usage(state);
+			}
+		break;
 		
 		default:
 			return ARGP_ERR_UNKNOWN;
@@ -127,7 +427,9 @@ error_t parse_opt(int key, char *arg, struct argp_state *state){
 }
 
 struct argp argp = {options, parse_opt,
-	/* USAGE */ "[-f FREQ [-f FREQ ...]] FILE",
+	/* USAGE */ "[-f FREQ [-f FREQ ...]] [-F FREQ_FILE] FILE\n"
+	"[-f FREQ [-f FREQ ...]] [-F FREQ_FILE] --capture[=DEVICE]\n"
+	"[-f FREQ [-f FREQ ...]] [-F FREQ_FILE] --stream PATH [--stream PATH ...]",
 	/* Documentation */
 	"Display Spectrogram for a given audio file\v"
 	"[1]: Note that the scaling factor is also applied to the calculated amplitude of each of the additional frequencies (those indicated with -f)\n"
@@ -158,7 +460,7 @@ void init_player(unsigned int sample_freq){
 	}
 }
 
-void play_samples(unsigned int count, double *samples){
+void play_samples(unsigned int count, sample_t *samples){
 	snd_pcm_sframes_t ret;
 	
 	// Convert to signed 16 bit data
@@ -185,35 +487,540 @@ void close_player(){
 
 
 
+snd_pcm_t *recorder;
+volatile sig_atomic_t capturing = 1;  // Cleared by SIGINT to stop capturing
+
+unsigned int capture_chnls;  // Number of interleaved channels being captured
+float *capture_buf = NULL;  // Frames from the most recently read period
+snd_pcm_uframes_t capture_len = 0, capture_pos = 0;  // Number of frames in buffer and how many have been used
+
+struct timespec capture_read;  // When the most recent period was read
+snd_pcm_sframes_t capture_delay;  // Frames queued in device when most recent period was read
+unsigned long capture_overruns = 0;
+
+// Latency statistics in seconds
+unsigned long latency_count = 0;
+double latency_sum = 0, latency_max = 0;
+
+void stop_capture(int sig){
+	capturing = 0;
+}
+
+void init_capture(const char *device, unsigned int sample_freq, unsigned int chnls){
+	int err;
+	if(err = snd_pcm_open(&recorder, device, SND_PCM_STREAM_CAPTURE, 0)){
+		printf("Error when opening capture device \"%s\": %s\n", device, snd_strerror(err));
+		exit(1);
+	}
+	
+	// Keep a few periods of buffering so that rendering can fall slightly behind without overrunning
+	if(err = snd_pcm_set_params(
+		recorder,
+		SND_PCM_FORMAT_FLOAT_LE,
+		SND_PCM_ACCESS_RW_INTERLEAVED,
+		chnls, sample_freq,
+		1 /* Soft Resample */, (unsigned int)(4e6 * capture_period / sample_freq)
+	)){
+		printf("Error while setting capture parameters: %s\n", snd_strerror(err));
+		exit(1);
+	}
+	
+	capture_chnls = chnls;
+	capture_buf = malloc(sizeof(float) * capture_period * chnls);
+	capture_len = capture_pos = 0;
+	
+	// Interrupt blocking reads on SIGINT so the footer and statistics can be printed
+	struct sigaction act = {0};
+	act.sa_handler = stop_capture;
+	sigaction(SIGINT, &act, NULL);
+	sigaction(SIGTERM, &act, NULL);
+}
+
+// Read `count` samples of channel `chnl` from capture device into `samples`
+// Returns number of samples read which is only less than `count` when capturing was stopped
+unsigned int capture_samples(unsigned int count, sample_t *samples, int chnl){
+	snd_pcm_sframes_t ret;
+	unsigned int j = 0;
+	while(j < count){
+		if(capture_pos >= capture_len){
+			if(!capturing) break;
+			
+			ret = snd_pcm_readi(recorder, capture_buf, capture_period);
+			if(ret == -EPIPE){
+				capture_overruns++;
+				fprintf(stderr, "Capture overrun, samples were dropped\n");
+			}
+			if(ret < 0){
+				if(!capturing) break;
+				if((ret = snd_pcm_recover(recorder, ret, 1)) < 0){
+					printf("Could not capture samples: %s\n", snd_strerror(ret));
+					exit(1);
+				}
+				continue;
+			}
+			
+			clock_gettime(CLOCK_MONOTONIC, &capture_read);
+			if(snd_pcm_delay(recorder, &capture_delay) < 0) capture_delay = 0;
+			capture_len = ret;
+			capture_pos = 0;
+		}
+		
+		samples[j++] = capture_buf[capture_pos++ * capture_chnls + chnl];
+	}
+	return j;
+}
+
+// Get when the last sample returned by `capture_samples` was read and how many seconds of audio followed it
+// Last returned sample was followed by the unused part of the buffer and the frames still queued in the device
+double capture_behind(unsigned int sample_freq, struct timespec *read){
+	*read = capture_read;
+	return (double)(capture_delay + capture_len - capture_pos) / sample_freq;
+}
+
+// Record the time between capturing a sample and now, given the values from `capture_behind`
+void capture_displayed(const struct timespec *read, double behind){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	
+	double latency = (now.tv_sec - read->tv_sec) + (now.tv_nsec - read->tv_nsec) / 1e9 + behind;
+	
+	latency_count++;
+	latency_sum += latency;
+	if(latency > latency_max) latency_max = latency;
+}
+
+void close_capture(){
+	snd_pcm_drop(recorder);
+	snd_pcm_close(recorder);
+	free(capture_buf);
+	
+	fflush(stdout);
+	fprintf(stderr, "Capture latency: %.2lfms mean, %.2lfms max over %lu lines\t\tOverruns: %lu\n",
+		latency_count ? 1000 * latency_sum / latency_count : 0, 1000 * latency_max, latency_count, capture_overruns
+	);
+}
+
+
+
+
+
+// Print amplitudes as characters, switching color only where it changes along the run
+void print_degrees(unsigned int count, const double *ampls){
+	char buf[ATTR_MAXLEN], chr;
+	int attr, shown = ATTR_PLAIN;
+	for(unsigned int i = 0; i < count; i++){
+		chr = degree_cell(scaling * ampls[i], is_grey, &attr);
+		if(attr != shown) fwrite(buf, 1, format_attr(buf, shown = attr), stdout);
+		putchar(chr);
+	}
+	if(shown != ATTR_PLAIN) fwrite(buf, 1, format_attr(buf, ATTR_PLAIN), stdout);
+}
+
+// Collect amplitudes of the extra frequency tables followed by those of the spectrum and its features into `ampls`
+// Amplitudes of the spectrum are only stored when they are printed or published
+void get_row(freqlist_t lst, spectrum_t spec, double *ampls){
+	int i;
+	for(i = 0; i < freqs_len; i++) ampls[i] = freqlist_get(lst, i);
+	spec_getall(spec, features_only && !publisher ? NULL : ampls + freqs_len, feats_len, feats, ampls + freqs_len + frq_count);
+}
+
+// Get number of columns of spectrum which fit in the terminal beside the others, or zero when output is not a terminal
+unsigned int fit_width(){
+	struct winsize w;
+	if(ioctl(fileno(stdout), TIOCGWINSZ, &w) < 0) return 0;
+	
+	// Compensate for other things which are displayed
+	int count = (int)w.ws_col - (11 + (streams_len > 0 ? 6 : 0) + (int)freqs_len * 9 + 1 + (int)feats_len * 11);
+	return count < 2 ? 2 : count;
+}
+
+void on_resize(int sig){
+	resized = 1;
+}
+
+// Print horizontal border of table
+void print_border(){
+	int i;
+	printf("+---------+");
+	if(streams_len > 0) printf("-----+");
+	for(i = 0; i < freqs_len; i++) printf("--------+");
+	if(!features_only){
+		for(i = 0; i < columns; i++) putchar('-');
+		putchar('+');
+	}
+	for(i = 0; i < feats_len; i++) printf("----------+");
+}
+
+// Write label of feature for headers, bounds of bands are shortened to fit
+void feature_label(char *buf, const spec_feature_t *feat){
+	const char *names[] = {"Centroid", "Peak", "Flux"};
+	double edges[2] = {feat->low, feat->high};
+	int len = 0;
+	if(feat->kind != FEAT_BAND){
+		strcpy(buf, names[feat->kind]);
+		return;
+	}
+	for(int e = 0; e < 2; e++){
+		if(e) buf[len++] = '-';
+		len += sprintf(buf + len, edges[e] >= 1000 ? "%gk" : "%g", edges[e] >= 1000 ? edges[e] / 1000 : edges[e]);
+	}
+}
+
+// Print headers of table between borders, labeling the tracked frequencies `tracked`
+void print_headers(const double *tracked){
+	int i;
+	header_freqs = tracked;
+	print_border();
+	printf("\n|  Time   |");
+	if(streams_len > 0) printf(" Str |");
+	for(i = 0; i < freqs_len; i++) printf(" %6.1lf |", tracked[i]);
+	if(!features_only) printf(" %*.1lf%*.1lf |", 1 - (int)columns / 2, low_frq, (int)columns - (int)columns / 2 - 1, upp_frq);
+	for(i = 0; i < feats_len; i++){
+		char label[64];
+		feature_label(label, feats + i);
+		printf(" %8.8s |", label);
+	}
+	putchar('\n');
+	print_border();
+}
+
+// Start new headers when the terminal was resized, following lines are pooled into its new width
+void follow_resize(){
+	if(!resized) return;
+	resized = 0;
+	
+	unsigned int width = fit_width();
+	if(width == 0 || width == columns) return;
+	columns = width;
+	putchar('\n');
+	print_headers(header_freqs);
+}
+
+// Print amplitudes of a line following its time
+void print_cells(const double *ampls){
+	int i;
+	// Print particular frequency table values
+	for(i = 0; i < freqs_len; i++){
+		if(ampls[i] >= 0) printf(" %6.4lf |", scaling * ampls[i]);
+	}
+	
+	// Print spectrum values, pooled when they do not match the columns
+	if(!features_only){
+		if(columns == frq_count){
+			print_degrees(frq_count, ampls + freqs_len);
+		}else{
+			double pooled[columns];
+			pool_columns(ampls + freqs_len, frq_count, pooled, columns, pool_mode == POOL_MEAN);
+			print_degrees(columns, pooled);
+		}
+		putchar('|');
+	}
+	
+	// Print features, frequencies in Hz and amplitudes scaled like those of tracked frequencies
+	const double *values = ampls + freqs_len + frq_count;
+	for(i = 0; i < feats_len; i++){
+		if(values[i] < 0) printf("          |");
+		else if(feats[i].kind == FEAT_CENTROID || feats[i].kind == FEAT_PEAK) printf(" %8.1lf |", values[i]);
+		else if(feats[i].kind == FEAT_FLUX) printf(" %8.3g |", scaling * values[i]);
+		else printf(" %8.3g |", scaling * scaling * values[i]);
+	}
+}
+
+// Print line of spectrogram for time `tm` using amplitudes collected by `get_row`
+void print_row(double tm, const double *ampls){
+	follow_resize();
+	printf("\n| %7.3f |", tm);
+	print_cells(ampls);
+}
+
+// Print line of stream `stream` as it is analyzed by the server
+void print_stream_row(unsigned int stream, double tm, const double *ampls){
+	follow_resize();
+	printf("\n| %7.3f | %3u |", tm, stream);
+	print_cells(ampls);
+}
 
 
-// Convert `scl` into colored character and print
-// `scl` should be in range [0, 1)
-void print_degree(double scl){
-	#define CHAR_COUNT 7
-	static char chrs[CHAR_COUNT] = " `'\"*%#";
-	#define COLOR_COUNT 4
-	static char *colors[COLOR_COUNT] = {
-		"\033[35;40m",   // Magenta on Black
-		"\033[91;45m",   // Red on Magenta
-		"\033[93;101m",  // Yellow on Red
-		"\033[37;103m"   // White on Yellow
-	};
+
+// Write size of `bytes` in the largest binary unit it reaches
+void format_bytes(char *buf, double bytes){
+	const char *units[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+	int u;
+	for(u = 0; bytes >= 1024 && u < 4; u++) bytes /= 1024;
+	sprintf(buf, u ? "%.1lf %s" : "%.0lf %s", bytes, units[u]);
+}
+
+// Print estimated cost of computing the spectrum with each engine and mark the one `chosen`
+void explain_plan(unsigned int sampfrq, unsigned int step, size_t tracked, const spec_cost_t *costs, int chosen){
+	char mem[16];
+	printf("Spectrum: %i frequencies over %.1lfHz : %.1lfHz\t\tSampling Frequency: %uHz\t\tLine: %u samples\n",
+		frq_count, low_frq, upp_frq, sampfrq, step
+	);
+	printf("  Engine         Memory  Operations / Line  Error (bins)  Window / Needed\n");
+	for(int e = 0; e < SPEC_ENGINES; e++){
+		format_bytes(mem, costs[e].bytes);
+		printf("%c %-8s %12s %18.3e %13.2lf %16.2lf%s\n", e == chosen ? '*' : ' ', engine_names[e], mem,
+			costs[e].flops, costs[e].error, costs[e].smear,
+			memory_budget && tracked + costs[e].bytes > memory_budget ? "  over budget" : costs[e].accurate ? "" : "  inaccurate"
+		);
+	}
 	
-	int val;
-	if(is_grey){
-		val = (int)(scl * CHAR_COUNT);
-		if(val < 0) val = 0;
-		if(val >= CHAR_COUNT) val = CHAR_COUNT - 1;
+	format_bytes(mem, tracked);
+	printf("Tracked Frequencies: %s", mem);
+	if(memory_budget){
+		format_bytes(mem, memory_budget);
+		printf("\t\tMemory Budget: %s", mem);
+	}
+	if(chosen < 0) printf("\t\tNo engine fits within budget");
+	putchar('\n');
+}
+
+
+
+// Samples kept to refill windows when analysis resumes after quiet lines
+sample_t *gate_hist = NULL, *gate_buf = NULL;
+unsigned int gate_len = 0, gate_pos = 0;  // Length of history and position of oldest sample
+unsigned long gate_quiet = 0;  // Number of consecutive samples in quiet lines
+int gate_skipped = 0;  // Whether the analysis of previous lines was skipped
+
+// Prepare to skip quiet lines, keeping enough samples to refill the longest window
+void init_gate(freqlist_t lst, spectrum_t spec){
+	gate_len = spec_samps_perwin(spec);
+	if(lst && freqlist_samps_perwin(lst) > gate_len) gate_len = freqlist_samps_perwin(lst);
+	gate_hist = calloc(gate_len, sizeof(sample_t));
+	gate_buf = malloc(sizeof(sample_t) * gate_len);
+}
+
+void close_gate(){
+	free(gate_hist);
+	free(gate_buf);
+}
+
+// Get how many of the last of `count` samples are read when analyzing a line
+// Samples before them are skipped by every window so they need not be decoded
+unsigned int line_samps_needed(freqlist_t lst, spectrum_t spec, unsigned int count){
+	unsigned int needed = spec_samps_needed(spec, count);
+	if(lst && freqlist_samps_needed(lst, count) > needed) needed = freqlist_samps_needed(lst, count);
+	return needed;
+}
+
+// Push `count` samples to extra frequencies and spectrum then collect amplitudes into `ampls`
+// With gating, lines are left blank without analysis once every window only holds quiet lines
+void analyze_line(freqlist_t lst, spectrum_t spec, unsigned int count, sample_t *samps, double *ampls){
+	unsigned int i;
+	if(gate_hist){
+		// Compare mean square of the samples read by any window to level and remember them
+		unsigned int from = count > gate_len ? count - gate_len : 0;
+		double energy = 0;
+		for(i = from; i < count; i++){
+			energy += (double)samps[i] * samps[i];
+			gate_hist[gate_pos] = samps[i];
+			if(++gate_pos == gate_len) gate_pos = 0;
+		}
+		
+		if(energy < gate_level * gate_level * (count - from)){
+			if(gate_quiet < gate_len) gate_quiet += count;
+			if(gate_quiet >= gate_len){
+				gate_skipped = 1;
+				for(i = 0; i < freqs_len + frq_count; i++) ampls[i] = 0;
+				for(i = 0; i < feats_len; i++) ampls[freqs_len + frq_count + i] = -1;
+				if(feats_len > 0) spec_reset_flux(spec);
+				return;
+			}
+		}else{
+			gate_quiet = 0;
+		}
 		
-		printf("%c", chrs[val]);
+		// Refill windows with the quiet samples that were skipped before these
+		if(gate_skipped && count < gate_len){
+			memcpy(gate_buf, gate_hist + gate_pos, sizeof(sample_t) * (gate_len - gate_pos));
+			memcpy(gate_buf + gate_len - gate_pos, gate_hist, sizeof(sample_t) * gate_pos);
+			samps = gate_buf;
+			count = gate_len;
+		}
+		gate_skipped = 0;
+	}
+	
+	if(lst) freqlist_pushall(lst, count, samps);
+	spec_pushall(spec, count, samps);
+	get_row(lst, spec, ampls);
+}
+
+
+
+// Load pyramid from `path` if it matches the frequency axis `axis`, covers `length` frames and was analyzed like this run from `source`
+pyramid_t load_pyramid(const char *path, unsigned int bins, const double *axis, unsigned int length, const pyr_source_t *source){
+	FILE *fl = fopen(path, "rb");
+	if(!fl) return NULL;
+	
+	pyr_err err;
+	pyramid_t pyr = read_pyramid(fl, &err);
+	fclose(fl);
+	if(!pyr) return NULL;
+	
+	const pyr_source_t *src = pyramid_source(pyr);
+	int matches = pyramid_bins(pyr) == bins && pyramid_rate(pyr) == summary_rate && pyramid_length(pyr) == length
+		&& src->channel == source->channel && src->gate == source->gate && src->size == source->size
+		&& src->mtime_sec == source->mtime_sec && src->mtime_nsec == source->mtime_nsec;
+	for(int i = 0; matches && i < bins; i++) matches = pyramid_freq(pyr, i) == axis[i];
+	if(!matches){
+		free_pyramid(pyr);
+		return NULL;
+	}
+	return pyr;
+}
+
+// Analyze entire audio file at the finest resolution of the summary pyramid
+pyramid_t build_pyramid(wav_t wv, freqlist_t lst, spectrum_t spec, const double *axis, unsigned int length, const pyr_source_t *source){
+	unsigned int bins = freqs_len + frq_count;
+	unsigned int step = (unsigned int)(wav_sample_freq(wv) / summary_rate);
+	pyramid_t pyr = make_pyramid(bins, axis, summary_rate, source);
+	
+	sample_t samps[step];
+	double ampls[bins];
+	uint64_t idx = 0;
+	unsigned int j, first = step - line_samps_needed(lst, spec, step);
+	for(unsigned int n = 0; n < length; n++, idx += step){
+		for(j = first; j < step; j++) samps[j] = wav_fsampat(wv, idx + j, channel);
+		
+		analyze_line(lst, spec, step, samps, ampls);
+		pyramid_push(pyr, ampls);
+	}
+	return pyr;
+}
+
+
+// Line of spectrogram as it passes from being read through analysis to output
+typedef struct {
+	uint64_t idx;  // Index of first sample, capture can run past 2^32 samples
+	sample_t *samps;
+	double *ampls;
+	int last;  // Marks the end of the lines instead of holding one
+	
+	// When the last sample was captured and seconds of audio captured after it
+	struct timespec read;
+	double behind;
+} line_t;
+
+enum {STAGE_READ, STAGE_ANALYZE, STAGE_OUTPUT, STAGE_COUNT};
+
+// Source and analysis of lines shared by the stages
+struct stream_s {
+	wav_t wv;
+	freqlist_t lst;
+	spectrum_t spec;
+	unsigned int sampfrq, step;
+	unsigned int first;  // Index of first sample in line read by any window
+	uint64_t idx, max_idx;  // Index of next line and of where lines stop
+	unsigned long count;  // Number of lines read
+	
+	pipeline_t pl;
+	line_t *lines;  // Slots of pipeline
+};
+
+// Fill `ln` with the samples of the next line, returns zero once there are no more lines
+int read_line(struct stream_s *st, line_t *ln){
+	if(st->count > 0 && (st->idx >= st->max_idx || !capturing)) return 0;
+	
+	ln->idx = st->idx;
+	if(capture_dev){
+		// Stop without printing a partial line once capturing is interrupted
+		if(capture_samples(st->step, ln->samps, channel) < st->step) return 0;
+		ln->behind = capture_behind(st->sampfrq, &ln->read);
 	}else{
-		val = (int)(scl * CHAR_COUNT * COLOR_COUNT);
-		if(val < 0) val = 0;
-		if(val >= CHAR_COUNT * COLOR_COUNT) val = CHAR_COUNT * COLOR_COUNT - 1;
+		// Samples past the end of the last line are silent
+		for(unsigned int j = st->first; j < st->step; j++){
+			ln->samps[j] = st->idx + j < st->max_idx ? wav_fsampat(st->wv, st->idx + j, channel) : 0;
+		}
+	}
+	
+	st->idx += st->step;
+	st->count++;
+	return 1;
+}
+
+// Print line and play its samples
+void output_line(struct stream_s *st, line_t *ln){
+	print_row((double)ln->idx / st->sampfrq, ln->ampls);
+	if(publisher) publish_frame(publisher, (double)ln->idx / st->sampfrq, ln->ampls);
+	
+	// Display each line as soon as it is complete when capturing
+	if(capture_dev){
+		fflush(stdout);
+		capture_displayed(&ln->read, ln->behind);
+	}
+	
+	// Play sound
+	if(do_playback) play_samples(st->step, ln->samps);
+}
+
+// Lines must not be accessed after being released since the next stage may already be reusing them
+void *read_stage(void *arg){
+	struct stream_s *st = arg;
+	line_t *ln;
+	int last;
+	do{
+		ln = st->lines + pipeline_acquire(st->pl, STAGE_READ);
+		last = ln->last = !read_line(st, ln);
+		pipeline_release(st->pl, STAGE_READ);
+	}while(!last);
+	return NULL;
+}
+
+void *analyze_stage(void *arg){
+	struct stream_s *st = arg;
+	line_t *ln;
+	int last;
+	do{
+		ln = st->lines + pipeline_acquire(st->pl, STAGE_ANALYZE);
+		last = ln->last;
+		if(!last) analyze_line(st->lst, st->spec, st->step, ln->samps, ln->ampls);
+		pipeline_release(st->pl, STAGE_ANALYZE);
+	}while(!last);
+	return NULL;
+}
+
+// Read, analyze and output every line
+// With a queue, each stage runs on its own thread and works on up to `queue_len` lines ahead of the next
+void stream_lines(struct stream_s *st){
+	unsigned int depth = queue_len > 0 ? queue_len : 1;
+	unsigned int bins = freqs_len + frq_count + feats_len;
+	sample_t *samps = malloc(sizeof(sample_t) * st->step * depth);
+	double *ampls = malloc(sizeof(double) * bins * depth);
+	st->lines = malloc(sizeof(line_t) * depth);
+	for(unsigned int i = 0; i < depth; i++){
+		st->lines[i].samps = samps + i * st->step;
+		st->lines[i].ampls = ampls + i * bins;
+	}
+	st->count = 0;
+	
+	if(queue_len == 0){
+		line_t *ln = st->lines;
+		while(read_line(st, ln)){
+			analyze_line(st->lst, st->spec, st->step, ln->samps, ln->ampls);
+			output_line(st, ln);
+		}
+	}else{
+		st->pl = make_pipeline(STAGE_COUNT, depth);
+		pthread_t reader, analyzer;
+		pthread_create(&reader, NULL, read_stage, st);
+		pthread_create(&analyzer, NULL, analyze_stage, st);
+		
+		// Output from the main thread
+		line_t *ln;
+		while(!(ln = st->lines + pipeline_acquire(st->pl, STAGE_OUTPUT))->last){
+			output_line(st, ln);
+			pipeline_release(st->pl, STAGE_OUTPUT);
+		}
 		
-		printf("%s%c\033[0m", colors[val / CHAR_COUNT], chrs[val % CHAR_COUNT]);
+		pthread_join(reader, NULL);
+		pthread_join(analyzer, NULL);
+		free_pipeline(st->pl);
 	}
+	
+	free(st->lines);
+	free(ampls);
+	free(samps);
 }
 
 
@@ -222,138 +1029,278 @@ int main(int argc, char *argv[], char *envp[]){
 	
 	// Fit spectrum size to screen
 	if(frq_count < 0){
-		struct winsize w;
-		ioctl(fileno(stdout), TIOCGWINSZ, &w);
-		frq_count = w.ws_col;
-		// Compensate for other things which are displayed
-		frq_count -= 11 + freqs_len * 9 + 1;
+		frq_count = fit_columns ? FIT_BINS : fit_width();
+		if(frq_count < 2) frq_count = 2;
 	}
 	
-	FILE *fl = fopen(audio_file, "rb");
-	wav_err err;
-	wav_t wv = read_wav(fl, &err);
-	fclose(fl);
+	// Lines are pooled into the terminal from now on instead of printing every frequency
+	columns = frq_count;
+	if(fit_columns){
+		if(fit_width() > 0) columns = fit_width();
+		struct sigaction act = {0};
+		act.sa_handler = on_resize;
+		act.sa_flags = SA_RESTART;
+		sigaction(SIGWINCH, &act, NULL);
+	}
 	
-	switch(err){
-		case WAV_NOT_RIFF:
-		case WAV_NOT_WAVE:
-			printf("Incorrect format, not WAV file\n");
-			free_wav(wv);
+	// Serve every stream from this process until they end
+	if(streams_len > 0){
+		serve_opts_t opts = {
+			low_frq, upp_frq, frq_count, freqs_len, freqs,
+			lines_per_sec, window_dur, engine, tile_bins, tile_samps, channel, feats_len, feats,
+			workers > 0 ? workers : (unsigned int)sysconf(_SC_NPROCESSORS_ONLN),
+			print_stream_row
+		};
+		if(channel < 0){
+			printf("Channel must be positive: \"%i\"\n", channel);
 			exit(1);
-		break;
-		case WAV_NO_DATA:
-			printf("No data found in WAV file\n");
+		}
+		
+		for(unsigned int n = 0; n < streams_len; n++){
+			if(access(streams[n], R_OK)){
+				printf("Could not open stream: \"%s\"\n", streams[n]);
+				exit(1);
+			}
+		}
+		
+		print_headers(freqs);
+		int err = serve_streams(streams_len, streams, &opts);
+		if(!err){
+			putchar('\n');
+			print_border();
+			putchar('\n');
+		}
+		free(streams);
+		free(freqs);
+		free(feats);
+		return err;
+	}
+	
+	wav_t wv = NULL;
+	unsigned int sampfrq;
+	if(capture_dev){
+		if(channel < 0){
+			printf("Channel must be positive: \"%i\"\n", channel);
+			exit(1);
+		}
+		
+		// Capture enough channels to include the selected one
+		sampfrq = capture_freq;
+		init_capture(capture_dev, sampfrq, channel + 1);
+		printf("Capturing From: %s\t\tSampling Frequency: %uHz\t\tPeriod: %u frames\n", capture_dev, sampfrq, capture_period);
+	}else{
+		wav_err err;
+		wv = open_wav(audio_file, &err);
+		
+		switch(err){
+			case WAV_NOT_RIFF:
+			case WAV_NOT_WAVE:
+				printf("Incorrect format, not WAV or FLAC file\n");
+				free_wav(wv);
+				exit(1);
+			break;
+			case WAV_NO_DATA:
+				printf("No data found in WAV file\n");
+				free_wav(wv);
+				exit(1);
+			break;
+			case WAV_NO_FORMAT:
+				printf("No format chunk found in WAV file\n");
+				free_wav(wv);
+				exit(1);
+			break;
+			case WAV_NO_FILE:
+				printf("Could not open audio file: \"%s\"\n", audio_file);
+				exit(1);
+			break;
+			case WAV_BAD_FLAC:
+				printf("Unsupported FLAC stream, must have STREAMINFO with known length and samples of at most 24 bits\n");
+				exit(1);
+			break;
+		}
+		
+		// Check that channel is valid
+		if(channel < 0){
+			printf("Channel must be positive: \"%i\"\n", channel);
 			free_wav(wv);
 			exit(1);
-		break;
-		case WAV_NO_FORMAT:
-			printf("No format chunk found in WAV file\n");
+		}else if(channel >= wav_channels(wv)){
+			printf("Selected channel index, \"%i\", must be less than number of channels, \"%u\"\n", channel, wav_channels(wv));
 			free_wav(wv);
 			exit(1);
-		break;
+		}
+		
+		// Calculate what start_tm and end_tm are
+		double duration = wav_duration(wv);
+		if(start_tm < 0) start_tm += duration;
+		if(end_tm < 0) end_tm += duration;
+		
+		// Print file stats
+		sampfrq = wav_sample_freq(wv);
+		printf("Sampling Frequency: %uHz\t\tDuration: %.4lfs\t\tChannels: %u\n", sampfrq, duration, wav_channels(wv));
+		
+		// Also services the seek to the start time
+		if(read_ahead > 0) wav_read_ahead(wv, read_ahead * (unsigned int)(sampfrq / lines_per_sec));
 	}
 	
-	// Check that channel is valid
-	if(channel < 0){
-		printf("Channel must be positive: \"%i\"\n", channel);
-		free_wav(wv);
-		exit(1);
-	}else if(channel >= wav_channels(wv)){
-		printf("Selected channel index, \"%i\", must be less than number of channels, \"%u\"\n", channel, wav_channels(wv));
+	// Hand over to interactive viewer which computes lines as they are shown
+	if(is_interactive){
+		if(run_tui(wv, channel, start_tm, lines_per_sec, low_frq, upp_frq, scaling, is_grey, refresh_bytes)){
+			printf("Interactive viewer requires a terminal\n");
+			free_wav(wv);
+			exit(1);
+		}
 		free_wav(wv);
-		exit(1);
+		return 0;
 	}
 	
-	// Calculate what start_tm and end_tm are
-	double duration = wav_duration(wv);
-	if(start_tm < 0) start_tm += duration;
-	if(end_tm < 0) end_tm += duration;
-	
-	// Print file stats
-	unsigned int sampfrq = wav_sample_freq(wv);
-	printf("Sampling Frequency: %uHz\t\tDuration: %.4lfs\t\tChannels: %u\n", sampfrq, duration, wav_channels(wv));
-	
-	int i, j;  // Indices for looping
+	int i;  // Index for looping
 	
 	
 	// Initialize audio playback
 	if(do_playback) init_player(sampfrq);
 	
 	
-	// Initialize any extra frequency tables requested
-	freqtbl_t freq_tbls[freqs_len];
-	for(i = 0; i < freqs_len; i++){
-		freq_tbls[i] = gen_freqtbl(freqs[i], wav_sample_freq(wv), 0.1);
-		start_freqtbl(freq_tbls[i], 1 / lines_per_sec);
-	}
+	// Tables are analyzed at the finest resolution of the pyramid when summarizing
+	double maxdur = *pyramid_file ? 1 / summary_rate : window_dur > 0 ? window_dur : 1 / lines_per_sec;
+	
+	// Track any extra frequencies requested together
+	freqlist_t freq_lst = gen_freqlist(sampfrq, freqs_len, freqs, maxdur);
 	free(freqs);
 	
+	// Choose how to compute the spectrum with what the tracked frequencies leave of the budget
+	unsigned int step = (unsigned int)(sampfrq / (*pyramid_file ? summary_rate : lines_per_sec));
+	size_t tracked = freqlist_bytes(freq_lst);
+	spec_cost_t costs[SPEC_ENGINES];
+	int chosen = spec_plan(sampfrq, low_frq, upp_frq, frq_count, maxdur, step,
+		memory_budget == 0 ? 0 : tracked < memory_budget ? memory_budget - tracked : 1 /* Nothing fits */, costs
+	);
+	if(engine >= 0) chosen = memory_budget && tracked + costs[engine].bytes > memory_budget ? -1 : engine;
+	if(do_explain){
+		explain_plan(sampfrq, step, tracked, costs, chosen);
+		free_freqlist(freq_lst);
+		free_wav(wv);
+		return 0;
+	}
+	if(chosen < 0){
+		// Report the least memory of any engine which may be used
+		size_t least = costs[engine >= 0 ? engine : 0].bytes;
+		for(i = 0; engine < 0 && i < SPEC_ENGINES; i++) if(costs[i].bytes < least) least = costs[i].bytes;
+		char need[16], budget[16];
+		format_bytes(need, tracked + least);
+		format_bytes(budget, memory_budget);
+		printf("Analysis needs at least %s which exceeds the memory budget of %s, see --explain\n", need, budget);
+		exit(1);
+	}
+	
 	// Generate spectrum over specified range
-	spectrum_t spec = gen_spectrum(wav_sample_freq(wv), low_frq, upp_frq, frq_count, 1 / lines_per_sec);
+	spectrum_t spec = gen_spectrum_with(chosen, sampfrq, low_frq, upp_frq, frq_count, maxdur);
+	if(!spec){
+		printf("Invalid frequency range: %.1lfHz : %.1lfHz\n", low_frq, upp_frq);
+		exit(1);
+	}
+	if(tile_bins >= 0) spec_set_tile(spec, tile_bins, tile_samps > 0 ? tile_samps : spec_tile_samps(spec));
+	if(gate_level >= 0) init_gate(freq_lst, spec);
 	
+	// Find or build summary pyramid
+	// Frequency of each amplitude in a line, tracked frequencies first
+	unsigned int bins = freqs_len + frq_count;
+	double axis[bins];
+	for(i = 0; i < freqs_len; i++) axis[i] = freqlist_freq(freq_lst, i);
+	for(i = 0; i < frq_count; i++) axis[freqs_len + i] = spec_freq(spec, i);
 	
-	// Print top boarder
-	printf("+---------+");
-	for(i = 0; i < freqs_len; i++) printf("--------+");
-	for(i = 0; i < frq_count; i++) putchar('-');
-	putchar('+');
+	if(publish_name){
+		publisher = make_publisher(publish_name, bins, freqs_len, axis, PUBLISH_SLOTS, publish_replace);
+		if(!publisher && errno == EEXIST){
+			printf("Shared memory object already exists, it may belong to another publisher: \"%s\"\n", publish_name);
+			printf("Use --publish-replace to replace it\n");
+			exit(1);
+		}else if(!publisher){
+			printf("Could not create shared memory object: \"%s\"\n", publish_name);
+			exit(1);
+		}
+	}
 	
-	// Print Headers
-	printf("\n|  Time   |");
-	for(i = 0; i < freqs_len; i++) printf(" %6.1lf |", freqtbl_freq(freq_tbls[i]));
-	printf(" %*.1lf%*.1lf |", 1 - frq_count / 2, low_frq, frq_count - frq_count / 2 - 1, upp_frq);
+	pyramid_t pyr = NULL;
+	if(*pyramid_file){
+		uint64_t frames = wav_sample_count(wv) / (unsigned int)(sampfrq / summary_rate);
+		if(frames > UINT32_MAX){
+			printf("Audio file is too long for a summary pyramid at this resolution\n");
+			exit(1);
+		}
+		unsigned int length = (unsigned int)frames;
+		
+		// Pyramid is tied to the audio file it was built from, in case that is replaced or edited
+		struct stat info = {0};
+		stat(audio_file, &info);
+		pyr_source_t source = {channel, gate_level, info.st_size, info.st_mtim.tv_sec, info.st_mtim.tv_nsec};
+		pyr = load_pyramid(pyramid_file, bins, axis, length, &source);
+		if(!pyr){
+			pyr = build_pyramid(wv, freq_lst, spec, axis, length, &source);
+			
+			FILE *fl = fopen(pyramid_file, "wb");
+			if(!fl || write_pyramid(pyr, fl)){
+				printf("Could not save summary pyramid: \"%s\"\n", pyramid_file);
+			}
+			if(fl) fclose(fl);
+		}
+		printf("Summary Pyramid: %s\t\tResolution: %.4gs\t\tLevels: %u\n", pyramid_file, 1 / summary_rate, pyramid_levels(pyr));
+	}
 	
-	// Print lower boarder of headers
-	printf("\n+---------+");
-	for(i = 0; i < freqs_len; i++) printf("--------+");
-	for(i = 0; i < frq_count; i++) putchar('-');
-	putchar('+');
 	
+	// Print headers between boarders
+	print_headers(axis);
 	
-	unsigned int idx = wav_attime(wv, start_tm), step = (unsigned int)(sampfrq / lines_per_sec);
-	unsigned int max_idx = wav_attime(wv, end_tm);
 	
-	double samps[step];  // Allocate space for sample buffer
-	double ampl;  // Store calculated amplitudes
-	do{
-		printf("\n| %7.3f |", wav_atindex(wv, idx));
-		
-		// Get samples
-		for(j = 0; j < step && idx + j < max_idx; j++){
-			samps[j] = wav_fsampat(wv, idx + j, channel);
+	if(pyr){
+		// Each line pools the pyramid frames which fall within it
+		double ampls[freqs_len + frq_count];  // Store calculated amplitudes
+		double tm, frames_per_sec = (double)sampfrq / (unsigned int)(sampfrq / summary_rate);
+		unsigned int from, to;
+		for(unsigned int n = 0; (tm = start_tm + n / lines_per_sec) < end_tm; n++){
+			from = (unsigned int)(tm * frames_per_sec);
+			to = (unsigned int)((tm + 1 / lines_per_sec) * frames_per_sec);
+			if(to <= from) to = from + 1;
+			
+			if(pyramid_pool(pyr, from, to, pool_mode, ampls)) break;
+			print_row(tm, ampls);
+			if(publisher) publish_frame(publisher, tm, ampls);
 		}
-		
-		// Push samples to particular frequencies
-		for(i = 0; i < freqs_len; i++) freqtbl_pushall(freq_tbls[i], step, samps);
-		// Push samples to spectrum
-		spec_pushall(spec, step, samps);
-		
-		// Move index forward
-		idx += step;
-		
-		// Print particular frequency table values
-		for(i = 0; i < freqs_len; i++){
-			ampl = freqtbl_get(freq_tbls[i]);
-			if(ampl >= 0) printf(" %6.4lf |", scaling * ampl);
+	}else{
+		struct stream_s st = {wv, freq_lst, spec, sampfrq, (unsigned int)(sampfrq / lines_per_sec)};
+		// Only decode the samples some window will read unless all of them are played
+		st.first = do_playback ? 0 : st.step - line_samps_needed(freq_lst, spec, st.step);
+		if(capture_dev){
+			// Time is measured from the start of capture and a non-negative end time limits its duration
+			st.idx = 0;
+			st.max_idx = end_tm >= 0 ? (uint64_t)(sampfrq * end_tm) : UINT64_MAX;
+		}else{
+			st.idx = wav_attime(wv, start_tm);
+			st.max_idx = wav_attime(wv, end_tm);
 		}
-		
-		// Print spectrum values
-		for(i = 0; i < frq_count; i++) print_degree(scaling * spec_get(spec, i));
-		putchar('|');
-		
-		
-		// Play sound
-		if(do_playback) play_samples(step, samps);
-	}while(idx < max_idx);
+		stream_lines(&st);
+	}
 	
 	// Print footer
-	printf("\n+---------+");
-	for(i = 0; i < freqs_len; i++) printf("--------+");
-	for(i = 0; i < frq_count; i++) putchar('-');
-	printf("+\n");
+	putchar('\n');
+	print_border();
+	putchar('\n');
 	
 	// Close Player
 	if(do_playback) close_player();
+	// Close capture device and report statistics
+	if(capture_dev) close_capture();
+	// Report how often decoding had to wait for input
+	unsigned long blocks, stalls;
+	if(wv && !wav_read_stats(wv, &blocks, &stalls)){
+		fprintf(stderr, "Read-ahead: %lu of %lu blocks were not ready when needed\n", stalls, blocks);
+	}
+	
+	free_publisher(publisher);
+	free_pyramid(pyr);
+	free_freqlist(freq_lst);
+	close_gate();
+	free(feats);
 	
 	return 0;
 }
@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "publish.h"
+
+
+
+// Example consumer of frames published by `spectro --publish NAME`
+// Prints the time of each frame, how long after publishing it was read and its loudest frequencies
+// Any number of copies can read the same publisher at once
+int main(int argc, char *argv[]){
+	if(argc < 2){
+		printf("Usage: %s NAME\nRead frames published by `spectro --publish NAME`\n", argv[0]);
+		return 1;
+	}
+	
+	// Wait for publisher to start
+	subscriber_t sub;
+	struct timespec idle = {0, 1000000};
+	for(int i = 0; !(sub = open_subscriber(argv[1])); i++){
+		if(i == 5000){
+			printf("No publisher found: \"%s\"\n", argv[1]);
+			return 1;
+		}
+		nanosleep(&idle, NULL);
+	}
+	
+	unsigned int bins = subscriber_bins(sub), tracked = subscriber_tracked(sub);
+	printf("Publisher: %s\t\tTracked Frequencies: %u\t\tSpectrum Frequencies: %u\n", argv[1], tracked, bins - tracked);
+	
+	const publish_frame_t *frame;
+	unsigned long frames = 0;
+	unsigned int i, loudest;
+	double time, wall, latency;
+	struct timespec now;
+	while(!subscriber_done(sub)){
+		if(!(frame = subscriber_next(sub))){
+			nanosleep(&idle, NULL);  // Only sleep when there is nothing to read
+			continue;
+		}
+		
+		// Values are read in place then checked to have been stable
+		time = frame->time;
+		wall = frame->wall;
+		loudest = tracked;
+		for(i = tracked; i < bins; i++) if(frame->ampls[i] > frame->ampls[loudest]) loudest = i;
+		double peak = loudest < bins ? frame->ampls[loudest] : 0;
+		if(subscriber_lost(sub, frame)) continue;
+		
+		clock_gettime(CLOCK_REALTIME, &now);
+		latency = now.tv_sec + now.tv_nsec / 1e9 - wall;
+		printf("%9.3lfs  latency %8.3lfms", time, latency * 1000);
+		if(loudest < bins) printf("  peak %8.1lfHz %.4lf", subscriber_freq(sub, loudest), peak);
+		putchar('\n');
+		frames++;
+	}
+	
+	printf("Frames: %lu\t\tDropped: %lu\n", frames, subscriber_dropped(sub));
+	close_subscriber(sub);
+	return 0;
+}
@@ -0,0 +1,449 @@
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <math.h>
+#include <poll.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+
+#include "tui.h"
+#include "fourier.h"
+#include "render.h"
+
+
+
+/* Frame Cache
+ * Amplitudes are cached per cell, keyed by the line length, the samples per block of
+ * the frequency table, and the line index. Cells therefore stay valid when scrolling,
+ * panning or zooming as long as the same table is used for the same line.
+ */
+#define REFRESH_MS 20  // Time between sending the parts of a frame which exceeded `refresh_bytes`
+
+#define CACHE_CELLS (1 << 18)
+#define CACHE_BUCKETS (1 << 18)
+
+struct cell_s {
+	uint32_t step, perblk;  // Key
+	uint64_t line;
+	double ampl;
+	
+	int next;  // Next cell in same bucket
+	int newer, older;  // Neighbors in least recently used list
+};
+
+static struct cell_s *cells = NULL;
+static int *buckets = NULL;
+static int cell_count = 0;
+static int newest = -1, oldest = -1;
+
+static unsigned int cell_hash(uint32_t step, uint32_t perblk, uint64_t line){
+	uint64_t h = step * 0x9e3779b97f4a7c15ull;
+	h ^= perblk * 0xc2b2ae3d27d4eb4full + (h >> 29);
+	h ^= line * 0x165667b19e3779f9ull + (h >> 32);
+	return (unsigned int)(h ^ (h >> 31)) % CACHE_BUCKETS;
+}
+
+static void unlink_cell(int c){
+	if(cells[c].newer >= 0) cells[cells[c].newer].older = cells[c].older;
+	else newest = cells[c].older;
+	if(cells[c].older >= 0) cells[cells[c].older].newer = cells[c].newer;
+	else oldest = cells[c].newer;
+}
+
+static void push_newest(int c){
+	cells[c].newer = -1;
+	cells[c].older = newest;
+	if(newest >= 0) cells[newest].newer = c;
+	newest = c;
+	if(oldest < 0) oldest = c;
+}
+
+// Find cached amplitude and mark it as recently used, returns non-zero if missing
+static int cache_get(uint32_t step, uint32_t perblk, uint64_t line, double *ampl){
+	for(int c = buckets[cell_hash(step, perblk, line)]; c >= 0; c = cells[c].next){
+		if(cells[c].step == step && cells[c].perblk == perblk && cells[c].line == line){
+			unlink_cell(c);
+			push_newest(c);
+			*ampl = cells[c].ampl;
+			return 0;
+		}
+	}
+	return 1;
+}
+
+// Store amplitude, evicting the least recently used cell when full
+static void cache_put(uint32_t step, uint32_t perblk, uint64_t line, double ampl){
+	int c, *link;
+	if(cell_count < CACHE_CELLS){
+		c = cell_count++;
+	}else{
+		c = oldest;
+		unlink_cell(c);
+		
+		// Remove from its bucket
+		link = buckets + cell_hash(cells[c].step, cells[c].perblk, cells[c].line);
+		while(*link != c) link = &(cells[*link].next);
+		*link = cells[c].next;
+	}
+	
+	cells[c].step = step;
+	cells[c].perblk = perblk;
+	cells[c].line = line;
+	cells[c].ampl = ampl;
+	
+	link = buckets + cell_hash(step, perblk, line);
+	cells[c].next = *link;
+	*link = c;
+	push_newest(c);
+}
+
+
+
+// Audio being viewed
+static wav_t wav;
+static int channel;
+static unsigned int sampfrq;
+static uint64_t sample_count;
+
+// Decoded samples covering [samps_lo, samps_hi)
+static sample_t *samps = NULL;
+static uint64_t samps_lo = 0, samps_hi = 0;
+static unsigned int samps_cap = 0;
+
+// Current view
+static unsigned int step;  // Samples per line
+static uint64_t top;  // Index of first line shown
+static double low_frq, upp_frq;
+static double scaling;
+static int is_grey;
+
+// Terminal
+static struct termios saved_tio;
+static volatile sig_atomic_t resized = 0;
+static unsigned int width;  // Number of columns in terminal
+static unsigned int rows, cols;  // Number of lines and frequencies displayed
+static unsigned long computed = 0, reused = 0;  // Cells computed and found in cache by last redraw
+
+// Cells last sent to the terminal, so each redraw only sends those which changed
+static screen_t screen = NULL;
+static size_t refresh_bytes;  // Most bytes sent at once, zero for no limit
+
+// View which is on the terminal
+static uint64_t drawn_top;
+static unsigned int drawn_step = 0;
+static double drawn_low, drawn_upp, drawn_scaling;
+static int drawn_grey;
+
+
+// Get pointer to samples [begin, end), decoding them if necessary
+// Samples outside of the file are treated as silence
+static sample_t *get_samples(uint64_t begin, uint64_t end){
+	if(begin < samps_lo || end > samps_hi){
+		if(end - begin > samps_cap){
+			samps_cap = end - begin;
+			samps = realloc(samps, sizeof(sample_t) * samps_cap);
+		}
+		
+		for(uint64_t i = begin; i < end; i++){
+			samps[i - begin] = i < sample_count ? wav_fsampat(wav, i, channel) : 0;
+		}
+		samps_lo = begin;
+		samps_hi = end;
+	}
+	return samps + (begin - samps_lo);
+}
+
+// Fill `ampls` with the amplitudes of the table with `perblk` samples per block for each shown line
+// Only the lines missing from the cache are computed
+static void get_column(unsigned int perblk, double *ampls){
+	unsigned int r, win;
+	uint64_t end, begin;
+	int missing = 0;
+	
+	for(r = 0; r < rows; r++){
+		if((top + r) * step >= sample_count) ampls[r] = -1;
+		else if(cache_get(step, perblk, top + r, ampls + r)) missing = 1;
+		else reused++;
+	}
+	if(!missing) return;
+	
+	freqtbl_t tbl = make_freqtbl(sampfrq, perblk, 1);
+	start_freqtbl(tbl, (double)step / sampfrq);
+	win = freqtbl_samps_perwin(tbl);
+	
+	// Compute runs of missing lines by sliding the window across them
+	int running = 0;
+	for(r = 0; r < rows && (top + r) * step < sample_count; r++){
+		if(!cache_get(step, perblk, top + r, ampls + r)){
+			running = 0;
+			continue;
+		}
+		
+		end = (top + r + 1) * step;
+		if(running){
+			freqtbl_pushall(tbl, step, get_samples(end - step, end));
+		}else{
+			begin = end > win ? end - win : 0;
+			clear_freqtbl(tbl);
+			freqtbl_pushall(tbl, end - begin, get_samples(begin, end));
+			running = 1;
+		}
+		
+		ampls[r] = freqtbl_get(tbl);
+		cache_put(step, perblk, top + r, ampls[r]);
+		computed++;
+	}
+	free_freqtbl(tbl);
+}
+
+
+
+static void measure(){
+	struct winsize w;
+	if(ioctl(STDOUT_FILENO, TIOCGWINSZ, &w) < 0 || w.ws_col == 0){
+		w.ws_col = 80;
+		w.ws_row = 24;
+	}
+	
+	// Compensate for the time column, borders, headers and status line
+	width = w.ws_col;
+	cols = w.ws_col > 14 ? w.ws_col - 12 : 2;
+	rows = w.ws_row > 5 ? w.ws_row - 4 : 1;
+	
+	// New screen starts by clearing the terminal
+	free_screen(screen);
+	screen = make_screen(rows + 4, width);
+}
+
+// Draw view and send the cells which changed, returns non-zero if some are left to send
+static int redraw(){
+	unsigned int r, c, col;
+	char text[256], chr;
+	int attr;
+	double ampls[cols][rows];
+	
+	// Compute amplitudes for each column
+	double ratio = pow(upp_frq / low_frq, 1 / (double)(cols - 1));
+	double f = low_frq;
+	computed = reused = 0;
+	for(c = 0; c < cols; c++, f *= ratio){
+		if(f >= sampfrq / 2.0){
+			for(r = 0; r < rows; r++) ampls[c][r] = -1;
+		}else{
+			get_column((unsigned int)(sampfrq / f), ampls[c]);
+		}
+	}
+	
+	// When only the top line moved the lines already on the terminal are scrolled into place
+	long moved = (long)top - drawn_top;
+	if(step == drawn_step && low_frq == drawn_low && upp_frq == drawn_upp && scaling == drawn_scaling && is_grey == drawn_grey){
+		if(moved != 0 && labs(moved) < rows) screen_scroll(screen, 3, rows + 2, (int)moved);
+	}
+	drawn_top = top;
+	drawn_step = step;
+	drawn_low = low_frq;
+	drawn_upp = upp_frq;
+	drawn_scaling = scaling;
+	drawn_grey = is_grey;
+	
+	screen_erase(screen);
+	
+	// Headers
+	for(r = 0; r < 3; r += 2){
+		col = screen_print(screen, r, 0, "+---------+", ATTR_PLAIN);
+		for(c = 0; c < cols; c++) screen_put(screen, r, col + c, '-', ATTR_PLAIN);
+		screen_put(screen, r, col + cols, '+', ATTR_PLAIN);
+	}
+	snprintf(text, sizeof(text), "|  Time   | %*.1lf%*.1lf |", 1 - (int)cols / 2, low_frq, (int)cols - (int)cols / 2 - 1, upp_frq);
+	screen_print(screen, 1, 0, text, ATTR_PLAIN);
+	
+	// Lines of spectrogram
+	for(r = 0; r < rows && (top + r) * step < sample_count; r++){
+		snprintf(text, sizeof(text), "| %7.3f |", (double)(top + r) * step / sampfrq);
+		col = screen_print(screen, 3 + r, 0, text, ATTR_PLAIN);
+		for(c = 0; c < cols; c++){
+			chr = degree_cell(scaling * ampls[c][r], is_grey, &attr);
+			screen_put(screen, 3 + r, col + c, chr, attr);
+		}
+		screen_put(screen, 3 + r, col + cols, '|', ATTR_PLAIN);
+	}
+	
+	// Status line is truncated to avoid scrolling the screen
+	int len = snprintf(text, sizeof(text), " %.4g lines/s  x%.4g  computed %lu  cached %lu  sent %zuB  "
+		"[arrows/hjkl] scroll  [+-] time zoom  [][] freq zoom  [<>] scale  [g] grey  [q] quit",
+		(double)sampfrq / step, scaling, computed, reused, screen_sent(screen)
+	);
+	if(len >= (int)sizeof(text)) len = sizeof(text) - 1;
+	if(len >= (int)width) len = width - 1;
+	text[len] = '\0';
+	screen_print(screen, rows + 3, 0, text, ATTR_INVERSE);
+	
+	return screen_flush(screen, STDOUT_FILENO, refresh_bytes);
+}
+
+
+
+static void on_resize(int sig){
+	resized = 1;
+}
+
+static int start_terminal(){
+	if(!isatty(STDIN_FILENO) || tcgetattr(STDIN_FILENO, &saved_tio) < 0) return 1;
+	
+	struct termios tio = saved_tio;
+	tio.c_lflag &= ~(ICANON | ECHO);
+	tio.c_cc[VMIN] = 1;
+	tio.c_cc[VTIME] = 0;
+	if(tcsetattr(STDIN_FILENO, TCSAFLUSH, &tio) < 0) return 1;
+	
+	// Let SIGWINCH interrupt poll so resizes are handled immediately
+	struct sigaction act = {0};
+	act.sa_handler = on_resize;
+	sigaction(SIGWINCH, &act, NULL);
+	
+	// Switch to alternate screen and hide cursor
+	fputs("\033[?1049h\033[?25l\033[2J", stdout);
+	fflush(stdout);
+	return 0;
+}
+
+static void stop_terminal(){
+	fputs("\033[?25h\033[?1049l", stdout);
+	fflush(stdout);
+	tcsetattr(STDIN_FILENO, TCSAFLUSH, &saved_tio);
+	signal(SIGWINCH, SIG_DFL);
+}
+
+static void scroll_lines(long delta){
+	long pos = (long)top + delta;
+	long last = (long)((sample_count - 1) / step);
+	if(pos > last) pos = last;
+	if(pos < 0) pos = 0;
+	top = (uint64_t)pos;
+}
+
+// Change number of lines per second keeping the top line at the same time
+static void set_step(unsigned int new_step){
+	if(new_step < 1) new_step = 1;
+	if(new_step > sample_count) new_step = sample_count;
+	top = (uint64_t)((double)top * step / new_step);
+	step = new_step;
+	scroll_lines(0);
+}
+
+// Move frequency range by `shift` columns and scale its width by `zoom`, about its center
+static void move_range(double shift, double zoom){
+	double ratio = pow(upp_frq / low_frq, 1 / (double)(cols - 1));
+	double center = sqrt(low_frq * upp_frq) * pow(ratio, shift);
+	double half = sqrt(upp_frq / low_frq);
+	
+	half = pow(half, zoom);
+	if(half < 1.01) half = 1.01;
+	if(center / half < 1) center = half;
+	if(center * half > sampfrq / 2.0) center = sampfrq / 2.0 / half;
+	if(center / half < 1) return;  // Range too wide to fit
+	
+	low_frq = center / half;
+	upp_frq = center * half;
+}
+
+int run_tui(wav_t wv, int chnl, double start, double rate, double low, double high, double scl, int grey, size_t max_bytes){
+	wav = wv;
+	channel = chnl;
+	sampfrq = wav_sample_freq(wv);
+	sample_count = wav_sample_count(wv);
+	if(sample_count == 0) return 1;
+	
+	step = (unsigned int)(sampfrq / rate);
+	if(step < 1) step = 1;
+	top = 0;
+	scroll_lines((long)(wav_attime(wv, start) / step));
+	low_frq = low;
+	upp_frq = high;
+	scaling = scl;
+	is_grey = grey;
+	refresh_bytes = max_bytes;
+	
+	if(start_terminal()) return 1;
+	
+	cells = malloc(sizeof(struct cell_s) * CACHE_CELLS);
+	buckets = malloc(sizeof(int) * CACHE_BUCKETS);
+	memset(buckets, -1, sizeof(int) * CACHE_BUCKETS);
+	cell_count = 0;
+	newest = oldest = -1;
+	
+	measure();
+	int pending = redraw();
+	
+	char keys[64], key;
+	ssize_t len;
+	int quit = 0, changed;
+	struct pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+	while(!quit){
+		// Keep sending the rest of a frame which exceeded the byte limit until a key is pressed
+		if(poll(&pfd, 1, pending ? REFRESH_MS : -1) < 0 && errno != EINTR) break;
+		changed = 0;
+		if(resized){
+			resized = 0;
+			measure();
+			changed = 1;
+		}
+		
+		// Apply every pending key before redrawing once
+		len = 0;
+		if(pfd.revents & POLLIN) len = read(STDIN_FILENO, keys, sizeof(keys));
+		if(len > 0) changed = 1;
+		for(ssize_t i = 0; i < len; i++){
+			// Translate escape sequences for arrow and page keys
+			key = keys[i];
+			if(key == '\033' && i + 2 < len && keys[i + 1] == '['){
+				i += 2;
+				switch(keys[i]){
+					case 'A': key = 'k'; break;
+					case 'B': key = 'j'; break;
+					case 'C': key = 'l'; break;
+					case 'D': key = 'h'; break;
+					case '5': key = 'b'; break;
+					case '6': key = ' '; break;
+				}
+				if(i + 1 < len && keys[i + 1] == '~') i++;
+			}
+			
+			switch(key){
+				case 'q': quit = 1; break;
+				case 'k': scroll_lines(-1); break;
+				case 'j': scroll_lines(1); break;
+				case 'b': scroll_lines(-(int)rows); break;
+				case ' ': scroll_lines(rows); break;
+				case 'h': move_range(-(double)cols / 8, 1); break;
+				case 'l': move_range((double)cols / 8, 1); break;
+				case '[': move_range(0, 2); break;
+				case ']': move_range(0, 0.5); break;
+				case '+': set_step(step / 2); break;
+				case '-': set_step(step * 2); break;
+				case '>': scaling *= 1.25; break;
+				case '<': scaling /= 1.25; break;
+				case 'g': is_grey = !is_grey; break;
+			}
+		}
+		
+		if(quit) break;
+		pending = changed ? redraw() : screen_flush(screen, STDOUT_FILENO, refresh_bytes);
+	}
+	
+	stop_terminal();
+	free(cells);
+	free(buckets);
+	free(samps);
+	free_screen(screen);
+	samps = NULL;
+	screen = NULL;
+	samps_lo = samps_hi = samps_cap = 0;
+	drawn_step = 0;
+	return 0;
+}
@@ -0,0 +1,14 @@
+#ifndef _TUI_H
+#define _TUI_H
+
+#include <stddef.h>
+
+#include "wav.h"
+
+// Run interactive viewer for channel `chnl` of `wv` until the user quits
+// The view starts at time `start` with `rate` lines per second covering frequencies [low, high]
+// Only cells which changed are redrawn, sending at most `max_bytes` bytes at a time unless it is zero
+// Returns non-zero if the terminal could not be configured
+int run_tui(wav_t wv, int chnl, double start, double rate, double low, double high, double scaling, int grey, size_t max_bytes);
+
+#endif
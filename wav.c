@@ -4,6 +4,7 @@
 #include <stdlib.h>
 
 #include "wav.h"
+#include "flac.h"
 
 
 
@@ -12,6 +13,7 @@
 #define WAVE_FORMAT_ALAW 0x0006
 #define WAVE_FORMAT_MULAW 0x0007
 #define WAVE_FORMAT_EXTENSIBLE 0xfffe
+#define WAVE_FORMAT_FLAC 0xf1ac  // Not a real format tag, marks samples which come from `flac`
 typedef uint16_t wav_fmt_code;
 
 struct wav_fmt_s {
@@ -31,6 +33,8 @@ struct wav_s {
 	
 	uint32_t size;
 	void *data;
+	
+	flac_t flac;  // Stream which samples are decoded from instead of `data`
 };
 
 
@@ -68,6 +72,7 @@ wav_t read_wav(FILE *fl, wav_err *err){
 	wv->dwSampleLength = 0;
 	wv->size = 0;
 	wv->data = NULL;
+	wv->flac = NULL;
 	*err = WAV_OK;
 	
 	// Loop through chunks
@@ -109,13 +114,60 @@ wav_t read_wav(FILE *fl, wav_err *err){
 	return wv;
 }
 
+wav_t open_wav(const char *path, wav_err *err){
+	FILE *fl = fopen(path, "rb");
+	if(!fl){
+		*err = WAV_NO_FILE;
+		return NULL;
+	}
+	
+	// FLAC file is kept open so that frames can be read as they are needed
+	flac_err ferr;
+	flac_t flc = open_flac(fl, &ferr);
+	if(ferr == FLAC_NOT_FLAC){
+		rewind(fl);
+		wav_t wv = read_wav(fl, err);
+		fclose(fl);
+		return wv;
+	}
+	if(!flc){
+		*err = WAV_BAD_FLAC;
+		fclose(fl);
+		return NULL;
+	}
+	
+	struct wav_fmt_s fmt = {0};
+	wav_t wv = malloc(sizeof(struct wav_s));
+	wv->format = fmt;
+	wv->format.wFormatTag = WAVE_FORMAT_FLAC;
+	wv->format.nChannels = flac_channels(flc);
+	wv->format.nSamplesPerSec = flac_sample_freq(flc);
+	wv->format.wBitsPerSample = flac_bits(flc);
+	wv->dwSampleLength = 0;
+	wv->size = 0;
+	wv->data = NULL;
+	wv->flac = flc;
+	*err = WAV_OK;
+	return wv;
+}
+
 void free_wav(wav_t wv){
 	if(!wv) return;
+	free_flac(wv->flac);
 	free(wv->data);
 	free(wv);
 }
 
 
+void wav_read_ahead(wav_t wv, unsigned int samples){
+	if(wv->flac) flac_read_ahead(wv->flac, samples);
+}
+
+int wav_read_stats(wav_t wv, unsigned long *blocks, unsigned long *stalls){
+	if(!wv->flac) return -1;
+	return flac_read_stats(wv->flac, blocks, stalls);
+}
+
 
 
 // Return sampling frequency of wav file
@@ -129,12 +181,14 @@ unsigned int wav_channels(wav_t wv){
 }
 
 // Get number of samples in wav file
-unsigned int wav_sample_count(wav_t wv){
+uint64_t wav_sample_count(wav_t wv){
+	if(wv->flac) return flac_sample_count(wv->flac);
 	return wv->size / wv->format.nBlockAlign;
 }
 
 // Return duration of wav file
 double wav_duration(wav_t wv){
+	if(wv->flac) return (double)flac_sample_count(wv->flac) / wv->format.nSamplesPerSec;
 	return (double)wv->size / (wv->format.nBlockAlign * wv->format.nSamplesPerSec);
 }
 
@@ -142,24 +196,32 @@ double wav_duration(wav_t wv){
 
 
 // Convert time to sample index
-unsigned int wav_attime(wav_t wv, double time){
-	return (unsigned int)(wv->format.nSamplesPerSec * time);
+uint64_t wav_attime(wav_t wv, double time){
+	return (uint64_t)(wv->format.nSamplesPerSec * time);
 }
 
 // Convert sample index to time
-double wav_atindex(wav_t wv, unsigned int idx){
+double wav_atindex(wav_t wv, uint64_t idx){
 	return (double)idx / wv->format.nSamplesPerSec;
 }
 
 // Does not check for wav format returns contents unchanged
-void *wav_sampat(wav_t wv, int sampidx, int chnl){
+void *wav_sampat(wav_t wv, uint64_t sampidx, int chnl){
+	if(wv->flac) return (void*)flac_sampat(wv->flac, sampidx, chnl);  // Decoded as 32 bit integer
 	return (void*)((uint8_t*)wv->data + sampidx * wv->format.nBlockAlign + chnl * wv->format.wBitsPerSample / 8);
 }
 
-double wav_fsampat(wav_t wv, int sampidx, int chnl){
+double wav_fsampat(wav_t wv, uint64_t sampidx, int chnl){
 	// Check bounds on sampidx and chnl
 	if(chnl < 0 || chnl >= wv->format.nChannels) return NAN;
-	if(sampidx < 0 || sampidx >= wv->size / wv->format.nBlockAlign) return NAN;
+	if(sampidx >= wav_sample_count(wv)) return NAN;
+	
+	const int32_t *fsamp;
+	if(wv->flac){
+		// Frames which could not be decoded are silent
+		fsamp = flac_sampat(wv->flac, sampidx, chnl);
+		return fsamp ? (double)*fsamp / (1 << (wv->format.wBitsPerSample - 1)) : 0;
+	}
 	
 	void *samp = wav_sampat(wv, sampidx, chnl);
 	int64_t lival;
@@ -2,6 +2,7 @@
 #define _WAV_H
 
 #include <stdio.h>
+#include <stdint.h>
 
 struct wav_s;
 typedef struct wav_s *wav_t;
@@ -11,30 +12,41 @@ typedef enum{
 	WAV_NOT_RIFF,
 	WAV_NOT_WAVE,
 	WAV_NO_DATA,
-	WAV_NO_FORMAT
+	WAV_NO_FORMAT,
+	WAV_NO_FILE,
+	WAV_BAD_FLAC
 } wav_err;
 
 // Extract data from file stream
 wav_t read_wav(FILE *fl, wav_err *err);
+// Open WAV or FLAC file at `path`, FLAC frames are decoded from the file as samples are requested
+wav_t open_wav(const char *path, wav_err *err);
 // Deallocate memory from wav
 void free_wav(wav_t wv);
 
+// Read streamed input ahead of decoding on a helper thread, keeping about `samples` samples buffered
+// WAV files are read whole when opened so this has no effect on them
+void wav_read_ahead(wav_t wv, unsigned int samples);
+// Get number of blocks read ahead which were used and how many of them were not ready in time
+// Returns non-zero when input is not being read ahead
+int wav_read_stats(wav_t wv, unsigned long *blocks, unsigned long *stalls);
+
 // Return sampling frequency of wav file
 unsigned int wav_sample_freq(wav_t wv);
 // Get number of channels in wav file
 unsigned int wav_channels(wav_t wv);
 // Get number of samples in wav file
-unsigned int wav_sample_count(wav_t wv);
+uint64_t wav_sample_count(wav_t wv);
 // Get duration of wav file
 double wav_duration(wav_t wv);
 
 // Convert time to sample index
-unsigned int wav_attime(wav_t wv, double time);
+uint64_t wav_attime(wav_t wv, double time);
 // Convert sample index to time
-double wav_atindex(wav_t wv, unsigned int idx);
+double wav_atindex(wav_t wv, uint64_t idx);
 // Does not check for wav format returns contents unchanged
-void *wav_sampat(wav_t wv, int sampidx, int chnl);
+void *wav_sampat(wav_t wv, uint64_t sampidx, int chnl);
 // Returns value of channel `chnl` at index `sampidx` normalized to [-1, 1)
-double wav_fsampat(wav_t wv, int sampidx, int chnl);
+double wav_fsampat(wav_t wv, uint64_t sampidx, int chnl);
 
 #endif